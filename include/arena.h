@@ -0,0 +1,22 @@
+#pragma once
+#include <memory_resource>
+#include <vector>
+#include <string>
+
+// Монотонная арена для временных буферов одного этапа (выборка колец, маски, списки соседей,
+// строки фич). Освобождение отдельных блоков - no-op, вся память возвращается разом в деструкторе.
+struct Arena
+{
+    explicit Arena(size_t initial_bytes = 1 << 20) : res(initial_bytes) {}
+    Arena(const Arena &) = delete;
+    Arena &operator=(const Arena &) = delete;
+
+    std::pmr::memory_resource *get() { return &res; }
+
+private:
+    std::pmr::monotonic_buffer_resource res;
+};
+
+template <class T>
+using avector = std::pmr::vector<T>;
+using astring = std::pmr::string;
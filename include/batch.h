@@ -0,0 +1,10 @@
+#pragma once
+#include <string>
+#include "roads.h"
+#include "config.h"
+
+// Перебор параметров: файл configs - по конфигу (JSON) на строку, ключи как в config.json,
+// не указанные берутся из base. Траншеи строятся один раз на каждое (trench_mode, boundary_sample_step, node_order),
+// ГНБ - один раз на группу с самыми мягкими параметрами и затем фильтруются под каждый конфиг.
+// Выходные файлы - <basename>_*.geojson, где basename из строки или <base.output_basename>_<номер>.
+int run_batch(const Roads &roads, const Config &base, const std::string &configs_path, int threads = 0);
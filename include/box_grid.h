@@ -0,0 +1,37 @@
+#pragma once
+#include <unordered_map>
+#include <vector>
+#include "geometry.h"
+
+// Равномерная сетка по охватывающим прямоугольникам объектов (дорог, препятствий):
+// какие объекты может задеть прямоугольник запроса. Ячейка - средний размер прямоугольника.
+class BoxGrid
+{
+public:
+    struct Box
+    {
+        double x0, y0, x1, y1;
+    };
+
+    static Box box_of(const std::vector<Pt> &pts);
+
+    void build(const std::vector<Box> &boxes);
+    bool empty() const { return count_ == 0; }
+
+    // Номера объектов, чьи ячейки задевает b, по возрастанию и без повторов
+    void query(const Box &b, std::vector<int> &out) const;
+    void query(const Seg &s, std::vector<int> &out) const
+    {
+        query(Box{std::min(s.a.x, s.b.x), std::min(s.a.y, s.b.y), std::max(s.a.x, s.b.x), std::max(s.a.y, s.b.y)},
+              out);
+    }
+
+private:
+    double cell_ = 1.0;
+    size_t count_ = 0;
+    std::unordered_map<long long, std::vector<int>> cells_;
+    std::vector<int> big_; // прямоугольник на слишком много ячеек - попадает в каждый запрос
+
+    long long ix(double v) const;
+    static long long key(long long ix, long long iy) { return (ix << 32) ^ (iy & 0xffffffff); }
+};
@@ -0,0 +1,30 @@
+#pragma once
+#include <string>
+#include <utility>
+#include <vector>
+#include "geometry.h"
+#include "graph.h"
+#include "hdd.h"
+
+// Связные компоненты графа (для траншей+ГНБ - по рёбрам HDDGraph: в нём есть и рёбра траншей,
+// а переходы связывают каждый узел траншеи с его узлом ГНБ).
+struct Components
+{
+    std::vector<int> of;        // номер компоненты узла; компоненты нумеруются по наименьшему узлу
+    std::vector<int> nodes;     // число узлов компоненты
+    std::vector<double> length; // суммарная длина рёбер компоненты, м
+
+    int count() const { return (int)nodes.size(); }
+};
+
+// Объединение-поиск без блокировок: рёбра обрабатываются параллельно, корни меняются CAS.
+Components connected_components(const std::vector<Pt> &nodes, const std::vector<std::pair<int, int>> &edges,
+                                int threads = 0);
+
+// Строка для отчёта: число компонент, крупнейшая, медиана, одиночные узлы, мелкие (< 10 узлов)
+std::string components_summary(const Components &c);
+
+// Удаляет из обоих графов узлы компонент c (посчитанных по hdd), в которых меньше min_nodes узлов
+// или рёбер короче min_length в сумме (нулевой порог не действует); номера узлов сжимаются.
+// Возвращает число удалённых компонент.
+int prune_components(TrenchGraph &trench, HDDGraph &hdd, const Components &c, int min_nodes, double min_length);
@@ -10,9 +10,20 @@ struct Config
     double hdd_min_length = 30.0;
     double hdd_max_length = 150.0;
     double hdd_alpha_deg = 10.0;
+    std::string hdd_mode = "full"; // full | lazy (рёбра ГНБ при поиске маршрута)
 
     double grid_step = 25.0;
     double boundary_step = 20.0;
+    std::string trench_mode = "strict"; // strict | union
+    double simplify_tolerance = 0.0;     // > 0 - упрощение колец дорог (simplify.h), м
+    double mask_cell = 1.0;              // ячейка масок занятости (occupancy.h), м; 0 - без масок
+    std::string node_order = "input";    // input | hilbert | rcm - нумерация узлов (reorder.h)
+
+    int prune_min_nodes = 0;       // компоненты связности меньше стольких узлов не выводятся (components.h)
+    double prune_min_length = 0.0; // ... и с суммарной длиной рёбер меньше, м; 0 - без отсева
 
     std::string output_basename = "graph";
+    std::string output_format = "geojson"; // geojson | fgb | mvt
+    int tile_min_zoom = 12; // для mvt
+    int tile_max_zoom = 17;
 };
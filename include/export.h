@@ -0,0 +1,62 @@
+#pragma once
+#include <map>
+#include <string>
+#include "config.h"
+#include "graph.h"
+#include "hdd.h"
+
+// Прямоугольник выгрузки части графа: узел попадает, если лежит внутри,
+// ребро - если внутри хотя бы один его конец.
+struct Region
+{
+    double x0, y0, x1, y1;
+    bool contains(const Pt &p) const { return p.x >= x0 && p.x <= x1 && p.y >= y0 && p.y <= y1; }
+};
+
+void save_text(const std::string &path, const std::string &data);
+
+// Свойства фич выходных файлов - общие для всех писателей
+std::map<std::string, std::string> node_props(const char *type, size_t id);
+std::map<std::string, std::string> edge_props(const char *type, double length, double price_per_m);
+std::map<std::string, std::string> transition_props(const Config &cfg);
+
+// Расширение файлов для cfg.output_format: ".geojson" или ".fgb" (FlatGeobuf, fgb_writer.h)
+const char *output_ext(const Config &cfg);
+
+// Все выходные файлы графа в формате cfg.output_format; для "mvt" - каталог тайлов (tiles.h).
+// С порогами cfg.prune_* пишется граф без мелких компонент связности (components.h).
+void write_graph(const std::string &base, const Config &cfg, const TrenchGraph &trench, const HDDGraph &hdd,
+                 const Region *region = nullptr, int threads = 0);
+
+// Выходной файл, сформированный в памяти, - чтобы форматирование и запись на диск
+// могли идти в разных потоках (pipeline.h)
+struct OutputFile
+{
+    std::string path;
+    std::string data;
+};
+
+// По одному выходному файлу: <base>_nodes_trench<ext>, _edges_trench, _nodes_hdd, _edges_hdd, _edges_transition
+OutputFile format_trench_nodes(const std::string &base, const Config &cfg, const TrenchGraph &trench,
+                               const Region *region = nullptr);
+OutputFile format_trench_edges(const std::string &base, const Config &cfg, const TrenchGraph &trench,
+                               const Region *region = nullptr);
+OutputFile format_hdd_nodes(const std::string &base, const Config &cfg, const HDDGraph &hdd,
+                            const Region *region = nullptr);
+OutputFile format_hdd_edges(const std::string &base, const Config &cfg, const HDDGraph &hdd,
+                            const Region *region = nullptr);
+// count (если задан) - число переходов
+OutputFile format_transitions(const std::string &base, const Config &cfg, const TrenchGraph &trench,
+                              const Region *region = nullptr, int *count = nullptr);
+
+// <base>_nodes_trench<ext>, <base>_edges_trench<ext>
+void write_trench(const std::string &base, const Config &cfg, const TrenchGraph &trench,
+                  const Region *region = nullptr);
+
+// <base>_nodes_hdd<ext>, <base>_edges_hdd<ext>
+void write_hdd(const std::string &base, const Config &cfg, const HDDGraph &hdd,
+               const Region *region = nullptr);
+
+// <base>_edges_transition<ext>, возвращает число переходов
+int write_transitions(const std::string &base, const Config &cfg, const TrenchGraph &trench,
+                      const Region *region = nullptr);
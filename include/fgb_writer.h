@@ -0,0 +1,40 @@
+#pragma once
+#include <string>
+#include <map>
+#include <vector>
+#include <utility>
+#include "geometry.h"
+
+// Писатель FlatGeobuf (https://flatgeobuf.org) с тем же интерфейсом, что у gj::Writer.
+// Фичи при записи сортируются по кривой Гильберта и снабжаются упакованным R-деревом,
+// так что просмотрщики читают только видимый участок. Типы колонок выводятся из значений:
+// целые - Long, числа - Double, остальное - String. Система координат - EPSG:3857.
+namespace fgb
+{
+
+    struct Writer
+    {
+        int crs_code = 3857;
+
+        void add_point(double x, double y, const std::map<std::string, std::string> &props);
+        void add_line(const std::vector<Pt> &pts, const std::map<std::string, std::string> &props);
+
+        // содержимое .fgb файла
+        std::string finish(const std::string &layer_name) const;
+
+    private:
+        struct Rec
+        {
+            bool line;
+            size_t first_pt, n_pts;
+            size_t first_val, n_vals;
+        };
+        std::vector<Rec> recs;
+        std::vector<Pt> pts;
+        std::vector<std::pair<int, std::string>> vals; // (колонка, значение)
+        std::vector<std::string> columns;
+
+        void add(bool line, const Pt *p, size_t n, const std::map<std::string, std::string> &props);
+    };
+
+}
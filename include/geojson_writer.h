@@ -1,15 +1,24 @@
 #pragma once
+#include <cstdio>
 #include <string>
 #include <map>
 #include <vector>
 #include "geometry.h"
+#include "arena.h"
 
 namespace gj
 {
 
     struct Writer
     {
-        std::vector<std::string> features;
+        // строки фич живут в арене писателя и освобождаются вместе с ним; сам список - в куче,
+        // чтобы при его росте старые массивы возвращались, а не копились в арене
+        Arena arena{4 << 20};
+        std::vector<astring> features;
+
+        // фича собирается здесь и копируется в арену один раз готовой: при дописывании прямо в
+        // арене каждый рост строки оставлял бы там старый буфер
+        std::string scratch;
 
         std::string crs_name = "urn:ogc:def:crs:EPSG::3857";
 
@@ -19,4 +28,27 @@ namespace gj
         std::string finish(const std::string &layer_name) const;
     };
 
+    // Тот же вывод, что у Writer, но фичи сразу пишутся в файл - память не растёт с их числом.
+    struct StreamWriter
+    {
+        StreamWriter(const std::string &path, const std::string &layer_name,
+                     const std::string &crs_name = "urn:ogc:def:crs:EPSG::3857");
+        ~StreamWriter();
+        StreamWriter(const StreamWriter &) = delete;
+        StreamWriter &operator=(const StreamWriter &) = delete;
+
+        void add_point(double x, double y, const std::map<std::string, std::string> &props);
+        void add_line(const std::vector<Pt> &pts, const std::map<std::string, std::string> &props);
+
+        // дописывает конец коллекции и закрывает файл
+        void finish();
+
+    private:
+        FILE *f = nullptr;
+        bool first = true;
+        std::string buf;
+
+        void flush_feature();
+    };
+
 }
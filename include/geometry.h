@@ -1,6 +1,8 @@
 #pragma once
 #include <cmath>
 #include <algorithm>
+#include <vector>
+#include "predicates.h"
 
 struct Pt
 {
@@ -25,62 +27,89 @@ inline double seg_len(const Seg &s) { return norm(s.b - s.a); }
 
 inline int sgn(double v, double eps = 1e-9) { return (v > eps) - (v < -eps); }
 
+// Допуск "точка лежит на границе", в метрах (EPSG:3857)
+const double ON_SEGMENT_TOL = 1e-7;
+
+inline int orient(Pt a, Pt b, Pt c) { return pred::orient2d(a.x, a.y, b.x, b.y, c.x, c.y); }
+
 inline bool on_segment(Pt p, Seg s)
 {
-    if (sgn(cross(s.b - s.a, p - s.a)) != 0)
-        return false;
-    return (std::min(s.a.x, s.b.x) - 1e-9 <= p.x && p.x <= std::max(s.a.x, s.b.x) + 1e-9 &&
-            std::min(s.a.y, s.b.y) - 1e-9 <= p.y && p.y <= std::max(s.a.y, s.b.y) + 1e-9);
+    if (orient(s.a, s.b, p) != 0)
+    {
+        double L = norm(s.b - s.a);
+        if (std::fabs(cross(s.b - s.a, p - s.a)) > ON_SEGMENT_TOL * std::max(L, 1e-12))
+            return false;
+    }
+    const double e = ON_SEGMENT_TOL;
+    return (std::min(s.a.x, s.b.x) - e <= p.x && p.x <= std::max(s.a.x, s.b.x) + e &&
+            std::min(s.a.y, s.b.y) - e <= p.y && p.y <= std::max(s.a.y, s.b.y) + e);
+}
+
+inline double dist_point_seg(Pt p, Seg s)
+{
+    Pt ab = s.b - s.a;
+    double den = norm2(ab);
+    double t = den > 0 ? std::max(0.0, std::min(1.0, dot(p - s.a, ab) / den)) : 0.0;
+    return norm(p - (s.a + ab * t));
 }
 
+// Факт пересечения определяется точными знаками ориентаций, точка пересечения - в double.
+// Касание концом (конец ближе ON_SEGMENT_TOL к другому отрезку) тоже считается пересечением:
+// узлы траншей получены интерполяцией вдоль границ и лежат на них лишь с точностью до округления.
 inline bool seg_intersect(Seg s1, Seg s2, Pt *ip = nullptr)
 {
-    Pt r = s1.b - s1.a;
-    Pt s = s2.b - s2.a;
-    double rxs = cross(r, s);
-    double qpxr = cross(s2.a - s1.a, r);
-    if (std::fabs(rxs) < 1e-12)
+    const double e = ON_SEGMENT_TOL;
+    if (std::max(s1.a.x, s1.b.x) + e < std::min(s2.a.x, s2.b.x) ||
+        std::max(s2.a.x, s2.b.x) + e < std::min(s1.a.x, s1.b.x) ||
+        std::max(s1.a.y, s1.b.y) + e < std::min(s2.a.y, s2.b.y) ||
+        std::max(s2.a.y, s2.b.y) + e < std::min(s1.a.y, s1.b.y))
+        return false;
+
+    int o1 = orient(s1.a, s1.b, s2.a);
+    int o2 = orient(s1.a, s1.b, s2.b);
+    int o3 = orient(s2.a, s2.b, s1.a);
+    int o4 = orient(s2.a, s2.b, s1.b);
+
+    bool proper = !(o1 * o2 > 0 || o3 * o4 > 0) &&
+                  !(o1 == 0 && o2 == 0) && !(o3 == 0 && o4 == 0);
+    if (proper)
     {
-        if (std::fabs(qpxr) < 1e-12)
+        if (ip)
         {
-            auto between = [&](double a, double b, double c)
-            { return (std::min(a, b) - 1e-12 <= c && c <= std::max(a, b) + 1e-12); };
-            if (between(s1.a.x, s1.b.x, s2.a.x) && between(s1.a.y, s1.b.y, s2.a.y))
-            {
-                if (ip)
-                    *ip = s2.a;
-                return true;
-            }
-            if (between(s1.a.x, s1.b.x, s2.b.x) && between(s1.a.y, s1.b.y, s2.b.y))
+            if (o1 == 0)
+                *ip = s2.a;
+            else if (o2 == 0)
+                *ip = s2.b;
+            else if (o3 == 0)
+                *ip = s1.a;
+            else if (o4 == 0)
+                *ip = s1.b;
+            else
             {
-                if (ip)
-                    *ip = s2.b;
-                return true;
+                Pt r = s1.b - s1.a;
+                Pt s = s2.b - s2.a;
+                double t = cross(s2.a - s1.a, s) / cross(r, s);
+                *ip = s1.a + r * std::max(0.0, std::min(1.0, t));
             }
-            if (between(s2.a.x, s2.b.x, s1.a.x) && between(s2.a.y, s2.b.y, s1.a.y))
-            {
-                if (ip)
-                    *ip = s1.a;
-                return true;
-            }
-            if (between(s2.a.x, s2.b.x, s1.b.x) && between(s2.a.y, s2.b.y, s1.b.y))
-            {
-                if (ip)
-                    *ip = s1.b;
-                return true;
-            }
-            return false;
         }
-        return false;
-    }
-    double t = cross(s2.a - s1.a, s) / rxs;
-    double u = cross(s2.a - s1.a, r) / rxs;
-    if (t >= -1e-12 && t <= 1 + 1e-12 && u >= -1e-12 && u <= 1 + 1e-12)
-    {
-        if (ip)
-            *ip = s1.a + r * t;
         return true;
     }
+
+    // коллинеарные и вырожденные случаи, а также касание концом в пределах допуска
+    for (Pt c : {s2.a, s2.b})
+        if (dist_point_seg(c, s1) <= e)
+        {
+            if (ip)
+                *ip = c;
+            return true;
+        }
+    for (Pt c : {s1.a, s1.b})
+        if (dist_point_seg(c, s2) <= e)
+        {
+            if (ip)
+                *ip = c;
+            return true;
+        }
     return false;
 }
 
@@ -93,9 +122,13 @@ inline bool point_in_polygon(const Pt &p, const std::vector<Pt> &ring)
         Pt a = ring[i], b = ring[j];
         if (on_segment(p, {a, b}))
             return false;
-        bool cond = ((a.y > p.y) != (b.y > p.y)) && (p.x < (b.x - a.x) * (p.y - a.y) / (b.y - a.y + 1e-18) + a.x);
-        if (cond)
-            c = !c;
+        if ((a.y > p.y) != (b.y > p.y))
+        {
+            // p левее пересечения луча с ребром <=> знак ориентации совпадает с направлением ребра по y
+            int o = orient(a, b, p);
+            if (b.y > a.y ? o > 0 : o < 0)
+                c = !c;
+        }
     }
     return c;
 }
@@ -7,8 +7,38 @@ struct TrenchGraph
 {
     std::vector<Pt> nodes;
     std::vector<std::pair<int, int>> edges;
+    int removed_edges = 0;      // дубли и перекрытия, убранные canonicalize_trench_edges
+    int open_outline_rings = 0; // union: незамкнувшиеся контуры объединения, по ним узлов нет
 };
 
 std::vector<Pt> sample_ring(const std::vector<Pt> &ring, double h);
 
-TrenchGraph build_trench_strict(const Roads &roads, double boundary_step);
+// Отрезок s идёт через дорогу poly: пересекает её границу не в своих концах
+// или хотя бы две из точек 0.2, 0.4, 0.6, 0.8 его длины лежат внутри.
+// Оба условия требуют пересечения s с охватывающим прямоугольником poly.
+bool seg_crosses_road(const Seg &s, const Polygon &poly);
+
+// seg_crosses_road для всех дорог, кроме selfIdx (-1 - для всех)
+bool seg_crosses_other_roads(const Seg &s, const Roads &roads, int selfIdx = -1);
+
+// Где узел встретился впервые: полигон, отрезок выборки и место в цепочке узлов этого отрезка.
+// Порядок (poly, seg, slot) совпадает с порядком номеров узлов.
+struct NodeOrigin
+{
+    int poly, seg, slot;
+};
+
+// origin (если задан) получает NodeOrigin для каждого узла. Узлы внутри roads.obstacles
+// не ставятся, рёбра, задевающие препятствия, отбрасываются (так же в build_trench_union).
+TrenchGraph build_trench_strict(const Roads &roads, double boundary_step,
+                                std::vector<NodeOrigin> *origin = nullptr);
+
+// То же, что build_trench_strict, но узлы ставятся вдоль заранее посчитанной границы
+// объединения дорог (outline.h): без проверок inside_any_other / seg_crosses_other_roads.
+TrenchGraph build_trench_union(const Roads &roads, double boundary_step);
+
+// Приводит рёбра к виду (u < v), разбивает каждое ребро в узлах, лежащих на нём внутри и
+// начинающих коллинеарное ему ребро (так перекрывающиеся отрезки соседних полигонов распадаются
+// на общие куски; Т-образные примыкания не режутся), и убирает повторы.
+// Возвращает число исходных рёбер, от которых не осталось ни одного куска.
+int canonicalize_trench_edges(TrenchGraph &g, int threads = 0);
@@ -1,13 +1,18 @@
 #pragma once
 #include <vector>
 #include <utility>
+#include <unordered_map>
 #include "roads.h"
+#include "config.h"
 
 struct HDDGraph
 {
     std::vector<Pt> nodes;
     std::vector<std::pair<int, int>> edges;
     std::vector<int> trench_to_hdd;
+
+    int trench_edge_count = 0;      // первые trench_edge_count рёбер - копия рёбер траншей
+    std::vector<double> edge_alpha; // наименьший alpha_deg, при котором ребро проходит (0 для траншей)
 };
 
 struct HDDParams
@@ -15,9 +20,49 @@ struct HDDParams
     double cross_min = 3.0;
     double cross_max = 50.0;
     double cross_angle_tol_deg = 20.0;
+
+    // искать наименьший alpha по всем дорогам, а не до первой подходящей -
+    // нужно, чтобы потом отфильтровать граф под более строгие параметры (filter_hdd)
+    bool min_alpha_over_roads = false;
 };
 
+HDDParams make_hdd_params(const Config &cfg);
+
+// Наименьший alpha, при котором отрезок a-b (a - узел с меньшим номером) проходит как
+// поперечное ребро ГНБ; бесконечность - не проходит при prm
+double cross_edge_alpha(const Roads &roads, const Pt &a, const Pt &b, const HDDParams &prm);
+
+// Поперечные рёбра, задевающие roads.obstacles, не строятся.
 HDDGraph build_hdd_from_trench(const Roads &roads,
                                const std::vector<Pt> &trench_nodes,
                                const std::vector<std::pair<int, int>> &trench_edges,
                                const HDDParams &prm);
+
+// Подграф ГНБ для более строгих параметров из графа, построенного с более мягкими
+// (меньший min_length, больший max_length и alpha, min_alpha_over_roads = true).
+HDDGraph filter_hdd(const HDDGraph &loose, const HDDParams &prm);
+
+// Граф ГНБ без предварительного построения поперечных рёбер: соседи узла считаются
+// при первом запросе (та же сетка и те же проверки, что в build_hdd_from_trench) и запоминаются.
+// roads и nodes должны жить дольше объекта.
+class LazyHDD
+{
+public:
+    LazyHDD(const Roads &roads, const std::vector<Pt> &nodes, const HDDParams &prm);
+
+    // Узлы j, для которых (i, j) - поперечное ребро ГНБ
+    const std::vector<int> &cross_neighbours(int i);
+
+    size_t expanded() const { return tested_; }
+    size_t edges_found() const { return found_; }
+
+private:
+    const Roads &roads_;
+    const std::vector<Pt> &nodes_;
+    HDDParams prm_;
+    double cell_;
+    std::unordered_map<long long, std::vector<int>> grid_;
+    std::unordered_map<int, std::vector<int>> memo_;
+    size_t tested_ = 0;
+    size_t found_ = 0;
+};
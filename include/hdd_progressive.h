@@ -0,0 +1,46 @@
+#pragma once
+#include <ostream>
+#include <string>
+#include <utility>
+#include <vector>
+#include "hdd.h"
+
+// Построение ГНБ по частям для больших районов: узлы идут кусками по кривой Гильберта
+// (внутри куска - параллельно), после каждого куска печатается скорость и оценка оставшегося
+// времени, готовые куски дописываются в файл контрольной точки. Перезапуск с тем же файлом
+// и теми же входными данными продолжает с первого недостроенного куска. По истечении
+// бюджета времени возвращается частичный граф: у узлов готовых кусков есть все поперечные рёбра,
+// у остальных - только рёбра к узлам готовых кусков.
+// Полный прогон даёт те же рёбра в том же порядке, что build_hdd_from_trench.
+struct ProgressiveHDD
+{
+    int chunk_nodes = 4096;
+    double time_budget_s = 0.0;  // > 0 - остановиться после куска, на котором бюджет исчерпан
+    std::string checkpoint;      // файл контрольной точки; пусто - без неё
+    std::ostream *log = nullptr; // строки "HDD progress: ..."
+    int threads = 0;
+};
+
+// Покрытие частичного графа: прямоугольник узлов каждого куска и готов ли он
+struct HDDCoverage
+{
+    struct Chunk
+    {
+        double x0, y0, x1, y1;
+        int nodes = 0;
+        bool done = false;
+        bool resumed = false; // взят из контрольной точки
+    };
+    std::vector<Chunk> chunks;
+    bool complete = false;
+    double seconds = 0.0;
+
+    int done() const;
+};
+
+HDDGraph build_hdd_progressive(const Roads &roads, const std::vector<Pt> &trench_nodes,
+                               const std::vector<std::pair<int, int>> &trench_edges, const HDDParams &prm,
+                               const ProgressiveHDD &opt, HDDCoverage *coverage = nullptr);
+
+// <base>_hdd_coverage.geojson: контур каждого куска (свойства chunk, nodes, status: done | resumed | pending)
+void write_hdd_coverage(const std::string &base, const HDDCoverage &coverage);
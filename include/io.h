@@ -1,5 +1,7 @@
 #pragma once
+#include <functional>
 #include <string>
+#include <vector>
 #include "roads.h"
 #include "config.h"
 
@@ -10,6 +12,26 @@ namespace io
 
     bool load_config(const std::string &path, Config &cfg);
 
+    // Разбор ключей конфига из строки JSON (config.json или строка запроса сервера);
+    // отсутствующие ключи оставляют значения cfg без изменений.
+    void parse_config_text(const std::string &s, Config &cfg);
+
+    // Поиск значения по ключу в плоском JSON; false, если ключа нет.
+    bool extract_double(const std::string &s, const std::string &key, double &dst);
+    bool extract_string(const std::string &s, const std::string &key, std::string &dst);
+    bool extract_numbers(const std::string &s, const std::string &key, std::vector<double> &dst);
+
     bool load_roads_geojson(const std::string &path, Roads &roads);
 
+    // Слой препятствий (Polygon, MultiPolygon, LineString) дописывается в obstacles;
+    // индекс после загрузки всех слоёв - obstacles.build_index(). false, если в файле ничего нет.
+    bool load_obstacles_geojson(const std::string &path, Obstacles &obstacles);
+
+    // Разбор уже прочитанного текста GeoJSON
+    bool parse_roads_geojson(const std::string &text, Roads &roads);
+
+    // Потоковое чтение: f(text) для текста каждого объекта из массива "features",
+    // файл читается кусками, в памяти - только текущая фича. false, если файл не открылся.
+    bool for_each_feature(const std::string &path, const std::function<void(const std::string &)> &f);
+
 }
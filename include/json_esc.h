@@ -0,0 +1,49 @@
+#pragma once
+#include <cstdio>
+#include <string>
+
+// Строка в JSON без кавычек вокруг: кавычка, обратная косая и управляющие символы экранируются.
+// S - любая строка с push_back/append (std::string, astring).
+template <class S>
+inline void append_esc(S &o, const std::string &s)
+{
+    for (char c : s)
+    {
+        switch (c)
+        {
+        case '"':
+            o.append("\\\"", 2);
+            break;
+        case '\\':
+            o.append("\\\\", 2);
+            break;
+        case '\n':
+            o.append("\\n", 2);
+            break;
+        case '\r':
+            o.append("\\r", 2);
+            break;
+        case '\t':
+            o.append("\\t", 2);
+            break;
+        default:
+            if ((unsigned char)c < 0x20)
+            {
+                char buf[8];
+                int n = std::snprintf(buf, sizeof(buf), "\\u%04x", (unsigned)c);
+                o.append(buf, n);
+            }
+            else
+                o.push_back(c);
+        }
+    }
+}
+
+// "s" - строковое значение JSON в кавычках
+inline std::string json_str(const std::string &s)
+{
+    std::string o = "\"";
+    append_esc(o, s);
+    o += "\"";
+    return o;
+}
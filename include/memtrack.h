@@ -0,0 +1,72 @@
+#pragma once
+#include <cstddef>
+#include <ostream>
+
+// Учёт выделений памяти по стадиям и контейнерам. Метки (Stage, Tag) есть в core всегда и стоят
+// одну запись в thread_local; считать выделения начинает только замена operator new/delete из
+// отдельной библиотеки memtrack (опция CMake READER_MEMTRACK). Без неё счётчики пустые.
+// Блок относится к метке, активной в момент выделения, и освобождается по ней же.
+namespace memtrack
+{
+    // Метки выделения: номер пары (стадия, контейнер) в таблице; 0 - без меток
+    using Label = int;
+
+    // Текущая метка потока (для передачи в рабочие потоки, parallel.h)
+    Label current();
+    void set_current(Label l);
+
+    // Стадия: все выделения потока внутри - на неё (контейнер сбрасывается на "other").
+    // Имя копируется; стадии с тем же именем объединяются.
+    class Stage
+    {
+    public:
+        explicit Stage(const char *name);
+        ~Stage() { set_current(prev_); }
+        Stage(const Stage &) = delete;
+        Stage &operator=(const Stage &) = delete;
+
+    private:
+        Label prev_;
+    };
+
+    // Контейнер внутри текущей стадии (node_index, cross hits, строки фич...)
+    class Tag
+    {
+    public:
+        explicit Tag(const char *container);
+        ~Tag() { set_current(prev_); }
+        Tag(const Tag &) = delete;
+        Tag &operator=(const Tag &) = delete;
+
+    private:
+        Label prev_;
+    };
+
+    // Метку выставляет рабочий поток, созданный под чужой меткой
+    class Adopt
+    {
+    public:
+        explicit Adopt(Label l) : prev_(current()) { set_current(l); }
+        ~Adopt() { set_current(prev_); }
+        Adopt(const Adopt &) = delete;
+        Adopt &operator=(const Adopt &) = delete;
+
+    private:
+        Label prev_;
+    };
+
+    // true, если замена operator new/delete собрана в программу
+    bool installed();
+
+    // Отчёт: по стадии - число выделений, байты, пик живых байт; по контейнерам стадии - то же,
+    // от большего пика к меньшему, и наибольший отдельный блок.
+    void report(std::ostream &os, int containers_per_stage = 6);
+
+    // Для библиотеки-замены operator new/delete
+    namespace hooks
+    {
+        void mark_installed();
+        void on_alloc(Label l, size_t bytes);
+        void on_free(Label l, size_t bytes);
+    }
+}
@@ -0,0 +1,46 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// Кодирование одного тайла Mapbox Vector Tile (спецификация 2.1) без внешних библиотек.
+// Координаты - уже в системе тайла (0..extent, допускается выход за край на буфер).
+// Свойства - числа (пишутся как double).
+namespace mvt
+{
+
+    using TilePt = std::pair<int, int>;
+    using Props = std::vector<std::pair<const char *, double>>;
+
+    struct Layer
+    {
+        explicit Layer(std::string name, uint32_t extent = 4096) : name(std::move(name)), extent(extent) {}
+
+        std::string name;
+        uint32_t extent;
+
+        void add_point(TilePt p, const Props &props);
+        // несколько частей - одна фича MultiLineString; части короче двух точек пропускаются
+        void add_lines(const std::vector<std::vector<TilePt>> &parts, const Props &props);
+
+        bool empty() const { return features_.empty(); }
+
+        // сообщение Layer (без тега поля Tile.layers)
+        std::string encode() const;
+
+    private:
+        std::string features_; // подряд закодированные Feature с тегами
+        std::vector<std::string> keys_;
+        std::vector<double> values_;
+        std::unordered_map<std::string, uint32_t> key_index_;
+        std::unordered_map<uint64_t, uint32_t> value_index_;
+
+        void add_feature(int type, const std::vector<uint32_t> &geometry, const Props &props);
+    };
+
+    // сообщение Tile из непустых слоёв
+    std::string encode_tile(const std::vector<Layer> &layers);
+
+}
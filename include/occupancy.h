@@ -0,0 +1,34 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+#include "geometry.h"
+
+// Растровая маска кольца: ячейки целиком внутри, целиком снаружи или задетые границей.
+// Для точки в ячейке "внутри"/"снаружи" ответ polygon_contains - одно чтение из памяти,
+// точная проверка нужна только в граничных ячейках.
+struct OccupancyMask
+{
+    enum : uint8_t
+    {
+        OUTSIDE = 0,
+        INSIDE = 1,
+        BOUNDARY = 2
+    };
+
+    double x0 = 0, y0 = 0, cell = 0;
+    int nx = 0, ny = 0;
+    std::vector<uint8_t> cells; // по строкам, ny x nx
+
+    bool empty() const { return cells.empty(); }
+
+    // cell - сторона ячейки; если ячеек вышло бы больше max_cells, ячейка увеличивается
+    void build(const std::vector<Pt> &ring, double cell, size_t max_cells = 1 << 20);
+
+    uint8_t state(Pt p) const
+    {
+        double fx = (p.x - x0) / cell, fy = (p.y - y0) / cell;
+        if (!(fx >= 0 && fy >= 0 && fx < nx && fy < ny))
+            return OUTSIDE; // маска покрывает bbox кольца с запасом в ячейку
+        return cells[(size_t)fy * nx + (size_t)fx];
+    }
+};
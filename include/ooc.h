@@ -0,0 +1,14 @@
+#pragma once
+#include <cstddef>
+#include <string>
+#include "config.h"
+
+// Построение графа при ограниченной памяти (--mem-budget). Дороги читаются из GeoJSON потоком
+// и раскладываются по листьям адаптивного квадродерева (с запасом по краям, чтобы в листе было
+// всё, что влияет на его узлы и рёбра); каждый лист считается обычными build_trench_strict и LazyHDD.
+// Узлы и рёбра листьев сбрасываются во временные файлы, склейка узлов, нумерация и слияние
+// рёбер - внешней сортировкой (spill.h), выходные GeoJSON пишутся потоком.
+// Результат совпадает с построением в памяти. Только trench_mode = strict и формат geojson.
+// Возвращает код выхода для main.
+int run_out_of_core(const std::string &roads_path, const Config &cfg, const std::string &out_base,
+                    size_t budget_bytes);
@@ -0,0 +1,9 @@
+#pragma once
+#include <vector>
+#include "roads.h"
+
+// Граница объединения всех полигонов дорог, посчитанная один раз по исходным вершинам.
+// Каждый контур замкнут (back() == front()), внутренность объединения слева:
+// внешние контуры идут против часовой стрелки, дыры (кварталы внутри кольца дорог) - по часовой.
+// Цепочки кусков, которые при сборке не замкнулись, отбрасываются; их число - в *open_rings.
+std::vector<std::vector<Pt>> union_outline(const Roads &roads, int *open_rings = nullptr);
@@ -0,0 +1,66 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <thread>
+#include <vector>
+#include "memtrack.h"
+
+// Число рабочих потоков: threads > 0 - как задано, иначе по числу ядер.
+inline int worker_count(int threads = 0)
+{
+    if (threads > 0)
+        return threads;
+    return std::max(1, (int)std::thread::hardware_concurrency());
+}
+
+// Параллельный цикл по [0, n) с динамической раздачей индексов; f(i) должна быть потокобезопасной.
+template <class F>
+void parallel_for(int n, F &&f, int threads = 0)
+{
+    int T = std::min(worker_count(threads), n);
+    if (T <= 1)
+    {
+        for (int i = 0; i < n; ++i)
+            f(i);
+        return;
+    }
+    std::atomic<int> next{0};
+    std::vector<std::thread> pool;
+    pool.reserve(T);
+    const memtrack::Label label = memtrack::current(); // выделения рабочих потоков - на метку вызывающего
+    for (int t = 0; t < T; ++t)
+        pool.emplace_back([&]
+                          {
+            memtrack::Adopt adopt(label);
+            for (int i; (i = next.fetch_add(1)) < n;)
+                f(i); });
+    for (auto &th : pool)
+        th.join();
+}
+
+// Параллельная сортировка: куски сортируются независимо, затем попарно сливаются.
+template <class T, class Less = std::less<T>>
+void parallel_sort(std::vector<T> &v, int threads = 0, Less less = Less())
+{
+    int T_ = std::min(worker_count(threads), (int)(v.size() / 4096) + 1);
+    if (T_ <= 1)
+    {
+        std::sort(v.begin(), v.end(), less);
+        return;
+    }
+    std::vector<size_t> bound(T_ + 1);
+    for (int t = 0; t <= T_; ++t)
+        bound[t] = v.size() * t / T_;
+    parallel_for(T_, [&](int t)
+                 { std::sort(v.begin() + bound[t], v.begin() + bound[t + 1], less); }, T_);
+    for (size_t width = 1; width < (size_t)T_; width *= 2)
+    {
+        int pairs = (int)((T_ + 2 * width - 1) / (2 * width));
+        parallel_for(pairs, [&](int k)
+                     {
+            size_t lo = 2 * width * k, mid = std::min(lo + width, (size_t)T_), hi = std::min(lo + 2 * width, (size_t)T_);
+            if (mid < hi)
+                std::inplace_merge(v.begin() + bound[lo], v.begin() + bound[mid], v.begin() + bound[hi], less); }, pairs);
+    }
+}
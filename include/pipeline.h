@@ -0,0 +1,105 @@
+#pragma once
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <vector>
+
+// Очередь между стадиями конвейера: push ждёт, пока в очереди меньше capacity элементов,
+// pop - пока не появится элемент. После close() push ничего не кладёт, pop отдаёт остаток
+// и возвращает false. wait_s (если задан) получает время, проведённое в ожидании.
+template <class T>
+class BoundedQueue
+{
+public:
+    explicit BoundedQueue(size_t capacity) : cap_(capacity ? capacity : 1) {}
+
+    bool push(T v, double *wait_s = nullptr)
+    {
+        std::unique_lock<std::mutex> lk(mu_);
+        wait(lk, not_full_, [&]
+             { return closed_ || q_.size() < cap_; }, wait_s);
+        if (closed_)
+            return false;
+        q_.push_back(std::move(v));
+        not_empty_.notify_one();
+        return true;
+    }
+
+    bool pop(T &v, double *wait_s = nullptr)
+    {
+        std::unique_lock<std::mutex> lk(mu_);
+        wait(lk, not_empty_, [&]
+             { return closed_ || !q_.empty(); }, wait_s);
+        if (q_.empty())
+            return false;
+        v = std::move(q_.front());
+        q_.pop_front();
+        not_full_.notify_one();
+        return true;
+    }
+
+    void close()
+    {
+        std::lock_guard<std::mutex> lk(mu_);
+        closed_ = true;
+        not_full_.notify_all();
+        not_empty_.notify_all();
+    }
+
+private:
+    size_t cap_;
+    bool closed_ = false;
+    std::deque<T> q_;
+    std::mutex mu_;
+    std::condition_variable not_full_, not_empty_;
+
+    template <class Pred>
+    static void wait(std::unique_lock<std::mutex> &lk, std::condition_variable &cv, Pred ready, double *wait_s)
+    {
+        if (ready())
+            return;
+        auto t = std::chrono::steady_clock::now();
+        cv.wait(lk, ready);
+        if (wait_s)
+            *wait_s += std::chrono::duration<double>(std::chrono::steady_clock::now() - t).count();
+    }
+};
+
+// Стадии с зависимостями, каждая в своём потоке: стадия начинается, когда закончились
+// все стадии из deps. Если стадия бросила исключение, зависящие от неё не запускаются,
+// вызываются обработчики on_cancel (закрыть очереди, чтобы никто не ждал вечно),
+// а run() после завершения остальных пробрасывает первое исключение.
+class Pipeline
+{
+public:
+    // f(idle): idle - счётчик времени ожидания стадии (передаётся в BoundedQueue)
+    using StageFn = std::function<void(double &idle)>;
+
+    // Номер стадии; deps - номера уже добавленных стадий
+    int add(const std::string &name, StageFn f, std::vector<int> deps = {});
+    void on_cancel(std::function<void()> f) { cancel_.push_back(std::move(f)); }
+
+    void run();
+
+    // По стадии: интервал от начала run(), работа (без ожидания) и её доля от общего времени;
+    // в конце - сумма работы стадий против общего времени, т.е. достигнутое перекрытие.
+    void report(std::ostream &os) const;
+
+private:
+    struct Stage
+    {
+        std::string name;
+        StageFn f;
+        std::vector<int> deps;
+        double start = 0.0, end = 0.0, idle = 0.0;
+        bool ran = false;
+    };
+    std::vector<Stage> stages_;
+    std::vector<std::function<void()>> cancel_;
+    double wall_ = 0.0;
+};
@@ -0,0 +1,13 @@
+#pragma once
+
+// Адаптивные геометрические предикаты (по Shewchuk, "Adaptive Precision Floating-Point
+// Arithmetic and Fast Robust Geometric Predicates"): сначала обычный расчёт в double
+// с оценкой погрешности, и только в почти вырожденных случаях - точная арифметика разложений.
+
+namespace pred
+{
+
+    // Знак ориентации тройки (a, b, c): +1 - c слева от ab, -1 - справа, 0 - ровно на прямой.
+    int orient2d(double ax, double ay, double bx, double by, double cx, double cy);
+
+}
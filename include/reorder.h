@@ -0,0 +1,30 @@
+#pragma once
+#include <string>
+#include <utility>
+#include <vector>
+#include "graph.h"
+
+// Перенумерация узлов траншей для локальности в памяти. Номера из add_node_dedup идут в порядке
+// обхода полигонов, и соседние в пространстве узлы оказываются далеко друг от друга: поиск
+// соседей ГНБ, маршруты и компоненты связности прыгают по памяти. Граф после перенумерации
+// тот же с точностью до номеров; ГНБ, строящийся по траншеям, наследует новый порядок.
+struct NodeOrderStats
+{
+    size_t nodes = 0;
+    double span_before = 0.0; // среднее |u - v| по рёбрам до и после
+    double span_after = 0.0;
+};
+
+// Порядок узлов по кривой Гильберта в их охватывающем прямоугольнике: order[новый] = старый
+std::vector<int> hilbert_order(const std::vector<Pt> &nodes);
+
+// Обратный алгоритм Катхилла-Макки: обход в ширину от псевдопериферийного узла каждой компоненты,
+// соседи по возрастанию степени, затем порядок разворачивается. Компоненты и равные степени -
+// в порядке seed (обычно hilbert_order). order[новый] = старый.
+std::vector<int> rcm_order(int n, const std::vector<std::pair<int, int>> &edges, const std::vector<int> &seed);
+
+// Перенумерация по order (order[новый] = старый): рёбра приводятся к (u < v) и сортируются
+void renumber_trench(TrenchGraph &g, const std::vector<int> &order);
+
+// mode: "input" - без изменений, "hilbert", "rcm" (Гильберт, затем RCM)
+NodeOrderStats reorder_trench_nodes(TrenchGraph &g, const std::string &mode);
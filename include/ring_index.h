@@ -0,0 +1,53 @@
+#pragma once
+#include <vector>
+#include "geometry.h"
+
+// BVH над рёбрами кольца. Ребро k соединяет ring[k] и ring[k-1] (k = 0 - замыкающее ring[0]-ring[n-1]).
+// Строится только для сложных колец, пустой индекс означает обычный линейный обход.
+struct RingIndex
+{
+    struct Node
+    {
+        double x0, y0, x1, y1;
+        int first; // лист: начало в edges; внутренний узел: индекс правого потомка (левый - следующий)
+        int count; // лист: число рёбер; внутренний узел: 0
+    };
+
+    std::vector<Node> nodes;
+    std::vector<int> edges;
+
+    bool empty() const { return nodes.empty(); }
+
+    void build(const std::vector<Pt> &ring);
+
+    // f(k) для рёбер, чей bbox пересекает [x0,x1]x[y0,y1]; f возвращает true, чтобы прервать обход.
+    // Возвращает true, если обход прерван.
+    template <class F>
+    bool query(double x0, double y0, double x1, double y1, F &&f) const
+    {
+        if (nodes.empty())
+            return false;
+        int stack[64];
+        int sp = 0;
+        stack[sp++] = 0;
+        while (sp)
+        {
+            const Node &n = nodes[stack[--sp]];
+            if (n.x1 < x0 || n.x0 > x1 || n.y1 < y0 || n.y0 > y1)
+                continue;
+            if (n.count)
+            {
+                for (int i = n.first; i < n.first + n.count; ++i)
+                    if (f(edges[i]))
+                        return true;
+            }
+            else
+            {
+                int self = (int)(&n - nodes.data());
+                stack[sp++] = n.first;
+                stack[sp++] = self + 1;
+            }
+        }
+        return false;
+    }
+};
@@ -1,14 +1,67 @@
 #pragma once
 #include <vector>
 #include "geometry.h"
+#include "ring_index.h"
+#include "occupancy.h"
+#include "box_grid.h"
 
 struct Polygon
 {
     std::vector<Pt> ring;
+    RingIndex index;    // пустой, если кольцо простое или индекс не строился
+    OccupancyMask mask; // пустая, если маски не строились
+};
+
+// Препятствия помимо дорог (здания, трамвайные пути, охранные зоны): узлы траншей не ставятся
+// внутри полигонов, рёбра траншей и ГНБ не проходят через полигоны и не пересекают линии.
+// Проверки идут через сетку прямоугольников index - стоят мало, пока препятствий рядом нет.
+struct Obstacles
+{
+    std::vector<Polygon> polygons;
+    std::vector<std::vector<Pt>> lines;
+    BoxGrid index; // объекты: сначала polygons, затем lines
+
+    bool empty() const { return polygons.empty() && lines.empty(); }
+
+    // Индексы колец, маски занятости (cell > 0) и сетка; после изменения polygons/lines
+    void build_index(double mask_cell = 1.0);
+
+    bool contains(Pt p) const;           // точка внутри полигона-препятствия
+    bool blocks(const Seg &s) const;     // отрезок задевает границу полигона или линию, либо лежит внутри
 };
 
 struct Roads
 {
     std::vector<Polygon> polygons;
     std::vector<std::vector<Pt>> lines;
+    Obstacles obstacles; // не сохраняются в кэше этапов: загружаются отдельно (io::load_obstacles_geojson)
 };
+
+// Индексы рёбер для колец, в которых не меньше min_vertices вершин.
+void build_ring_indexes(Roads &roads, size_t min_vertices = 64);
+
+// Маски занятости колец с ячейкой cell (occupancy.h); cell <= 0 - убрать маски.
+void build_occupancy_masks(Roads &roads, double cell, int threads = 0);
+
+// point_in_polygon с использованием маски и индекса полигона, если они построены.
+bool polygon_contains(const Polygon &poly, Pt p);
+
+// f(k) для рёбер {ring[k-1], ring[k]} (k >= 1), которые могут пересечь отрезок s.
+// f возвращает true, чтобы прервать обход; функция возвращает true, если обход прерван.
+template <class F>
+bool for_each_ring_edge_near(const Polygon &poly, const Seg &s, F &&f)
+{
+    const auto &R = poly.ring;
+    if (poly.index.empty())
+    {
+        for (size_t k = 1; k < R.size(); ++k)
+            if (f((int)k))
+                return true;
+        return false;
+    }
+    const double e = ON_SEGMENT_TOL;
+    return poly.index.query(std::min(s.a.x, s.b.x) - e, std::min(s.a.y, s.b.y) - e,
+                            std::max(s.a.x, s.b.x) + e, std::max(s.a.y, s.b.y) + e,
+                            [&](int k)
+                            { return k >= 1 && f(k); });
+}
@@ -0,0 +1,63 @@
+#pragma once
+#include <vector>
+#include "roads.h"
+#include "graph.h"
+#include "hdd.h"
+#include "config.h"
+
+// Двухслойный граф для поиска маршрута: состояния [0, nT) - узлы траншей,
+// [nT, nT + nH) - узлы ГНБ. Переход между слоями в одной точке стоит transition_per_edge.
+struct RouteGraph
+{
+    int n_trench = 0;
+    std::vector<Pt> points;    // координаты состояний
+    std::vector<int> offset;   // CSR: дуги состояния s - [offset[s], offset[s + 1])
+    std::vector<int> target;
+    std::vector<double> length;
+    std::vector<char> kind;    // EDGE_TRENCH / EDGE_HDD / EDGE_TRANSITION
+    std::vector<int> component; // компонента связности состояния: из разных компонент маршрута нет
+};
+
+enum RouteEdgeKind : char
+{
+    EDGE_TRENCH = 0,
+    EDGE_HDD = 1,
+    EDGE_TRANSITION = 2
+};
+
+RouteGraph build_route_graph(const TrenchGraph &trench, const HDDGraph &hdd);
+
+struct Route
+{
+    bool found = false;
+    double cost = 0.0;
+    double trench_length = 0.0;
+    double hdd_length = 0.0;
+    int transitions = 0;
+    bool disconnected = false; // концы в разных компонентах - поиск не запускался
+    std::vector<int> states;   // от начала к концу
+};
+
+// Ближайший узел траншей к точке (-1, если узлов нет).
+int nearest_node(const std::vector<Pt> &nodes, Pt p);
+
+// Дейкстра между узлами траншей from и to (маршрут начинается и заканчивается в траншее).
+Route shortest_route(const RouteGraph &g, const Config &cfg, int from, int to);
+
+// Тот же двухслойный граф, но поперечные рёбра ГНБ не строятся заранее, а находятся
+// LazyHDD только для узлов, до которых дошла Дейкстра. Узлы ГНБ совпадают с узлами траншей:
+// состояния [0, nT) - траншея, [nT, 2nT) - ГНБ. trench и roads должны жить дольше графа.
+struct LazyRouteGraph
+{
+    LazyRouteGraph(const Roads &roads, const TrenchGraph &trench, const HDDParams &prm);
+
+    int n_trench = 0;
+    const std::vector<Pt> &nodes;
+    std::vector<int> offset; // CSR смежности траншей
+    std::vector<int> target;
+    LazyHDD hdd;
+
+    const Pt &point(int s) const { return nodes[s < n_trench ? s : s - n_trench]; }
+};
+
+Route shortest_route(LazyRouteGraph &g, const Config &cfg, int from, int to);
@@ -0,0 +1,25 @@
+#pragma once
+#include <istream>
+#include <ostream>
+#include <string>
+#include "session.h"
+
+// Долгоживущий режим: дороги и индексы загружены один раз, запросы - построчный JSON (NDJSON),
+// на каждый запрос одна строка JSON в ответ. Ключи конфига в запросе переопределяют базовый конфиг
+// только для этого запроса.
+//   {"cmd":"build", "min_length":40, "out":"run1"}          построить (или взять из кэша), опционально записать
+//   {"cmd":"route", "from":[x,y], "to":[x,y]}               маршрут между ближайшими узлами траншей
+//   {"cmd":"export", "bbox":[x0,y0,x1,y1], "out":"part"}    выгрузка части графа
+//   {"cmd":"stats"}, {"cmd":"clear"}, {"cmd":"quit"}
+namespace server
+{
+
+    // Обработать одну строку запроса; quit выставляется по команде quit.
+    std::string handle(Session &session, const Config &base, const std::string &line, bool &quit);
+
+    int run_stream(Session &session, const Config &base, std::istream &in, std::ostream &out);
+
+    // Unix-сокет; соединения обслуживаются по очереди.
+    int run_socket(Session &session, const Config &base, const std::string &path);
+
+}
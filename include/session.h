@@ -0,0 +1,113 @@
+#pragma once
+#include <algorithm>
+#include <iterator>
+#include <map>
+#include <memory>
+#include <cstdint>
+#include <tuple>
+#include <vector>
+#include <string>
+#include "roads.h"
+#include "config.h"
+#include "graph.h"
+#include "hdd.h"
+#include "route.h"
+#include "simplify.h"
+#include "reorder.h"
+#include "stage_cache.h"
+
+// Загруженные дороги и кэш этапов, зависящих от параметров конфига.
+// Этап пересчитывается, только если изменились параметры, от которых он зависит:
+// траншеи - trench_mode, boundary_sample_step и node_order, ГНБ - ещё и min/max_length, alpha_deg.
+// С включённым дисковым кэшем (disk) этапы также сохраняются на диск и берутся оттуда в следующих запусках.
+// В памяти каждого вида этапа хранится не больше max_cached наборов параметров: сверх этого
+// выбрасывается давно не использованный (из дискового кэша он потом читается заново).
+// Ссылки, полученные от trench()/hdd()/..., действительны, пока не запрошен этап с другими параметрами.
+
+// map с вытеснением давно не использованных записей
+template <class K, class V>
+struct LruMap
+{
+    V *find(const K &k)
+    {
+        auto it = items.find(k);
+        if (it == items.end())
+            return nullptr;
+        it->second.second = ++tick;
+        return &it->second.first;
+    }
+
+    // перед вставкой освобождает место до limit записей; on_evict(key) - до удаления записи
+    template <class F>
+    V &insert(const K &k, V v, size_t limit, F &&on_evict)
+    {
+        while (!items.empty() && items.size() >= std::max<size_t>(limit, 1))
+        {
+            auto old = items.begin();
+            for (auto it = items.begin(); it != items.end(); ++it)
+                if (it->second.second < old->second.second)
+                    old = it;
+            on_evict(old->first);
+            items.erase(old);
+        }
+        return items.emplace(k, std::make_pair(std::move(v), ++tick)).first->second.first;
+    }
+
+    template <class F>
+    void erase_if(F &&pred)
+    {
+        for (auto it = items.begin(); it != items.end();)
+            it = pred(it->first) ? items.erase(it) : std::next(it);
+    }
+
+    size_t size() const { return items.size(); }
+    void clear() { items.clear(); }
+
+private:
+    std::map<K, std::pair<V, uint64_t>> items;
+    uint64_t tick = 0;
+};
+
+struct Session
+{
+    Roads roads;
+    StageCache disk;
+    bool roads_from_disk = false;
+    SimplifyStats simplified; // пусто, если упрощения не было или дороги взяты из кэша
+    NodeOrderStats reordered; // последняя перенумерация узлов траншей; пусто, если её не было
+    size_t max_cached = 4;    // наборов параметров в памяти на вид этапа (траншеи, ГНБ, маршрутные графы)
+
+    // cfg.simplify_tolerance > 0 - кольца упрощаются сразу после разбора (и так хранятся в кэше);
+    // cfg.mask_cell > 0 - строятся маски занятости колец. obstacle_paths - слои препятствий
+    // (Roads::obstacles), их содержимое входит в ключи кэша этапов.
+    bool load(const std::string &roads_path, const Config &cfg = Config{},
+              const std::vector<std::string> &obstacle_paths = {});
+
+    const TrenchGraph &trench(const Config &cfg, bool *reused = nullptr);
+    const HDDGraph &hdd(const Config &cfg, bool *reused = nullptr);
+    const RouteGraph &route_graph(const Config &cfg);
+    LazyRouteGraph &lazy_route_graph(const Config &cfg);
+
+    size_t cached_trench() const { return trench_cache.size(); }
+    size_t cached_hdd() const { return hdd_cache.size(); }
+    void clear();
+
+private:
+    using TrenchKey = std::tuple<std::string, double, std::string>;
+    using HDDKey = std::tuple<std::string, double, std::string, double, double, double>;
+
+    static TrenchKey trench_key(const Config &cfg);
+    static HDDKey hdd_key(const Config &cfg);
+
+    // ключи дискового кэша
+    uint64_t roads_hash = 0;
+    uint64_t trench_hash(const Config &cfg) const;
+    uint64_t hdd_hash(const Config &cfg) const;
+
+    LruMap<TrenchKey, TrenchGraph> trench_cache;
+    LruMap<HDDKey, HDDGraph> hdd_cache;
+    LruMap<HDDKey, RouteGraph> route_cache;
+    // ссылается на траншеи из trench_cache и выбрасывается вместе с ними; память поперечных
+    // рёбер, найденных поиском, растёт не больше полного графа ГНБ
+    LruMap<HDDKey, std::unique_ptr<LazyRouteGraph>> lazy_cache;
+};
@@ -0,0 +1,23 @@
+#pragma once
+#include <vector>
+#include "roads.h"
+
+// Упрощение колец дорог (Дуглас-Пекер) до построения графа: меньше вершин - дешевле
+// point_in_polygon, seg_crosses_other_roads, поиск пересечений и проверки углов ГНБ.
+struct SimplifyStats
+{
+    size_t vertices_before = 0;
+    size_t vertices_after = 0;
+    double max_deviation = 0.0; // наибольшее расстояние от убранной вершины до нового кольца, м
+    int rings_kept = 0;         // кольца, оставленные как есть: упрощение ломало их
+};
+
+// Упрощает замкнутое кольцо с допуском tolerance. Результат проверяется: кольцо должно остаться
+// простым (без самопересечений и касаний несоседних рёбер), не меньше трёх вершин и с тем же
+// знаком площади; иначе допуск уменьшается вдвое, после нескольких неудач кольцо не меняется.
+// deviation - наибольшее отклонение убранных вершин, rejected - упрощать было что, но проверку
+// не прошёл ни один допуск. Возвращает false, если кольцо оставлено как есть.
+bool simplify_ring(std::vector<Pt> &ring, double tolerance, double *deviation = nullptr, bool *rejected = nullptr);
+
+// simplify_ring для всех полигонов, параллельно. Индексы колец нужно строить после.
+SimplifyStats simplify_roads(Roads &roads, double tolerance, int threads = 0);
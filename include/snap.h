@@ -0,0 +1,66 @@
+#pragma once
+#include <limits>
+#include <string>
+#include <utility>
+#include <vector>
+#include "roads.h"
+
+// Дерево k-d по точкам (узлам траншей): ближайшие k и все в радиусе за O(log n) на запрос.
+// Неявное: узлы - медианы отрезков массива перестановки, отдельных вершин дерева нет.
+// Точки должны жить дольше дерева.
+class KdTree
+{
+public:
+    explicit KdTree(const std::vector<Pt> &pts);
+
+    // До k ближайших на расстоянии не больше max_dist: пары (расстояние, номер точки) по возрастанию
+    void nearest(Pt q, int k, std::vector<std::pair<double, int>> &out,
+                 double max_dist = std::numeric_limits<double>::infinity()) const;
+
+    // Все точки на расстоянии не больше r, по возрастанию расстояния
+    void within(Pt q, double r, std::vector<std::pair<double, int>> &out) const;
+
+    size_t size() const { return idx_.size(); }
+
+private:
+    const std::vector<Pt> &pts_;
+    std::vector<int> idx_;
+
+    void build(int lo, int hi, int depth);
+};
+
+// Привязка внешних точек (вводы зданий, подстанции) к узлам траншей
+struct SnapParams
+{
+    int k = 1;                  // сколько ближайших узлов на точку
+    double radius = 0.0;        // > 0 - только узлы ближе radius (при k = 0 - все такие узлы)
+    const Roads *roads = nullptr; // если задано - отбрасывать привязки, отрезок которых идёт через дорогу
+    int max_candidates = 256;     // с roads: сколько ближайших узлов проверять на точку, не больше
+};
+
+struct Snap
+{
+    int node = -1;
+    double dist = 0.0;
+};
+
+struct SnapStats
+{
+    size_t snapped = 0;  // точек хотя бы с одной привязкой
+    size_t unsnapped = 0;
+    size_t rejected = 0; // кандидатов, отброшенных из-за пересечения дороги
+};
+
+// Привязки для каждой точки (по возрастанию расстояния), точки обрабатываются параллельно.
+// Отброшенный кандидат заменяется следующим по расстоянию, пока не наберётся k. Дорога,
+// внутри которой стоит сама точка, при проверке не учитывается.
+std::vector<std::vector<Snap>> snap_points(const std::vector<Pt> &nodes, const KdTree &tree,
+                                           const std::vector<Pt> &points, const SnapParams &prm,
+                                           SnapStats *stats = nullptr, int threads = 0);
+
+// Точки из GeoJSON (Point); ids - свойство "id" фичи или пустая строка. false, если файл не читается.
+bool load_points_geojson(const std::string &path, std::vector<Pt> &points, std::vector<std::string> &ids);
+
+// Файл <base>_snaps.geojson: по линии от точки к узлу на привязку (свойства point, id, node, rank, distance)
+void write_snaps(const std::string &base, const std::vector<Pt> &points, const std::vector<std::string> &ids,
+                 const std::vector<Pt> &nodes, const std::vector<std::vector<Snap>> &snaps);
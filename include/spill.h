@@ -0,0 +1,229 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <functional>
+#include <memory>
+#include <queue>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// Временные файлы записей фиксированного размера и внешняя сортировка для режима
+// ограниченной памяти (ooc.h). T - тривиально копируемая структура.
+// Временный файл, который не открылся или записался не целиком (например, кончилось место
+// на диске), - исключение SpillError: иначе дальше читались бы обрезанные данные.
+
+struct SpillError : std::runtime_error
+{
+    using std::runtime_error::runtime_error;
+};
+
+[[noreturn]] inline void spill_fail(const char *what, const std::string &path)
+{
+    throw SpillError(std::string(what) + " " + path);
+}
+
+// Уникальное имя временного файла в каталоге dir
+inline std::string spill_path(const std::string &dir, const char *tag)
+{
+    static std::atomic<unsigned> counter{0};
+    return dir + "/" + tag + "-" + std::to_string(counter++) + ".bin";
+}
+
+template <class T>
+class RecordWriter
+{
+public:
+    explicit RecordWriter(const std::string &path) : path_(path), f_(fopen(path.c_str(), "wb"))
+    {
+        if (!f_)
+            spill_fail("can't create temporary file", path_);
+    }
+    // без close() ошибка записи остатка буфера не заметна - закрывать явно
+    ~RecordWriter()
+    {
+        if (f_)
+            fclose(f_);
+    }
+    RecordWriter(const RecordWriter &) = delete;
+    RecordWriter &operator=(const RecordWriter &) = delete;
+
+    void push(const T &v)
+    {
+        if (fwrite(&v, sizeof(T), 1, f_) != 1)
+            spill_fail("can't write temporary file", path_);
+        ++count_;
+    }
+    void write(const void *p, size_t bytes)
+    {
+        if (fwrite(p, 1, bytes, f_) != bytes)
+            spill_fail("can't write temporary file", path_);
+    }
+    size_t count() const { return count_; }
+    const std::string &path() const { return path_; }
+    void close()
+    {
+        if (!f_)
+            return;
+        FILE *f = f_;
+        f_ = nullptr;
+        if (fclose(f) != 0)
+            spill_fail("can't write temporary file", path_);
+    }
+
+private:
+    std::string path_;
+    FILE *f_;
+    size_t count_ = 0;
+};
+
+template <class T>
+class RecordReader
+{
+public:
+    RecordReader(const std::string &path, size_t buffer_records = 4096)
+        : f_(fopen(path.c_str(), "rb")), buf_(std::max<size_t>(1, buffer_records)) {}
+    ~RecordReader()
+    {
+        if (f_)
+            fclose(f_);
+    }
+    RecordReader(const RecordReader &) = delete;
+    RecordReader &operator=(const RecordReader &) = delete;
+
+    bool ok() const { return f_ != nullptr; }
+
+    bool next(T &v)
+    {
+        if (pos_ == len_)
+        {
+            if (!f_)
+                return false;
+            len_ = fread(buf_.data(), sizeof(T), buf_.size(), f_);
+            pos_ = 0;
+            if (len_ == 0)
+                return false;
+        }
+        v = buf_[pos_++];
+        return true;
+    }
+
+private:
+    FILE *f_;
+    std::vector<T> buf_;
+    size_t pos_ = 0, len_ = 0;
+};
+
+// Сортировка потока записей в памяти не больше mem_bytes: куски сортируются и сбрасываются
+// на диск, затем сливаются (при большом числе кусков - в несколько проходов).
+template <class T, class Less = std::less<T>>
+class ExternalSorter
+{
+public:
+    ExternalSorter(std::string dir, size_t mem_bytes, Less less = Less())
+        : dir_(std::move(dir)), mem_(std::max<size_t>(mem_bytes, 1 << 16)), less_(less)
+    {
+        cap_ = std::max<size_t>(1, mem_ / sizeof(T));
+    }
+    ~ExternalSorter()
+    {
+        for (const auto &r : runs_)
+            std::remove(r.c_str());
+    }
+    ExternalSorter(const ExternalSorter &) = delete;
+    ExternalSorter &operator=(const ExternalSorter &) = delete;
+
+    void push(const T &v)
+    {
+        if (buf_.size() == cap_)
+            spill();
+        buf_.push_back(v);
+    }
+
+    // f(const T &) для всех записей по возрастанию; сортировщик после этого пуст
+    template <class F>
+    void drain(F &&f)
+    {
+        if (runs_.empty())
+        {
+            std::sort(buf_.begin(), buf_.end(), less_);
+            for (const auto &v : buf_)
+                f(v);
+            std::vector<T>().swap(buf_);
+            return;
+        }
+        if (!buf_.empty())
+            spill();
+        std::vector<T>().swap(buf_);
+
+        // не больше fan_in кусков за раз, у каждого буфер чтения не меньше 4 КБ
+        size_t fan_in = std::max<size_t>(2, mem_ / 2 / 4096);
+        while (runs_.size() > fan_in)
+        {
+            std::vector<std::string> next;
+            for (size_t b = 0; b < runs_.size(); b += fan_in)
+            {
+                std::vector<std::string> group(runs_.begin() + b, runs_.begin() + std::min(runs_.size(), b + fan_in));
+                RecordWriter<T> w(spill_path(dir_, "merge"));
+                merge(group, [&](const T &v)
+                      { w.push(v); });
+                w.close();
+                next.push_back(w.path());
+                for (const auto &r : group)
+                    std::remove(r.c_str());
+            }
+            runs_.swap(next);
+        }
+        merge(runs_, f);
+        for (const auto &r : runs_)
+            std::remove(r.c_str());
+        runs_.clear();
+    }
+
+private:
+    std::string dir_;
+    size_t mem_, cap_;
+    Less less_;
+    std::vector<T> buf_;
+    std::vector<std::string> runs_;
+
+    void spill()
+    {
+        std::sort(buf_.begin(), buf_.end(), less_);
+        RecordWriter<T> w(spill_path(dir_, "run"));
+        w.write(buf_.data(), buf_.size() * sizeof(T));
+        w.close();
+        runs_.push_back(w.path());
+        buf_.clear();
+    }
+
+    template <class F>
+    void merge(const std::vector<std::string> &runs, F &&f)
+    {
+        size_t per_run = std::max<size_t>(1, mem_ / 2 / runs.size() / sizeof(T));
+        std::vector<std::unique_ptr<RecordReader<T>>> readers;
+        using Head = std::pair<T, size_t>;
+        auto greater = [&](const Head &a, const Head &b)
+        { return less_(b.first, a.first) || (!less_(a.first, b.first) && a.second > b.second); };
+        std::priority_queue<Head, std::vector<Head>, decltype(greater)> pq(greater);
+        for (size_t r = 0; r < runs.size(); ++r)
+        {
+            readers.emplace_back(new RecordReader<T>(runs[r], per_run));
+            if (!readers.back()->ok())
+                spill_fail("can't open temporary file", runs[r]);
+            T v;
+            if (readers.back()->next(v))
+                pq.push({v, r});
+        }
+        while (!pq.empty())
+        {
+            auto [v, r] = pq.top();
+            pq.pop();
+            f(v);
+            T nv;
+            if (readers[r]->next(nv))
+                pq.push({nv, r});
+        }
+    }
+};
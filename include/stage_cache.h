@@ -0,0 +1,36 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include "roads.h"
+#include "graph.h"
+#include "hdd.h"
+
+// Дисковый кэш промежуточных этапов: <dir>/<stage>-<key>.bin в компактном двоичном виде.
+// Ключ - хэш входов этапа (байты файла дорог и поля конфига, от которых этап зависит),
+// поэтому при изменении входов просто получается другой файл. Чтение через mmap.
+class StageCache
+{
+public:
+    StageCache() = default;
+    explicit StageCache(std::string dir);
+
+    bool enabled() const { return !dir_.empty(); }
+
+    // FNV-1a, 64 бита
+    static uint64_t hash(const void *data, size_t n, uint64_t seed = 1469598103934665603ull);
+    static uint64_t hash(const std::string &s, uint64_t seed = 1469598103934665603ull) { return hash(s.data(), s.size(), seed); }
+    static uint64_t hash(double v, uint64_t seed) { return hash(&v, sizeof(v), seed); }
+
+    bool load(uint64_t key, Roads &roads) const;
+    bool load(uint64_t key, TrenchGraph &g) const;
+    bool load(uint64_t key, HDDGraph &g) const;
+
+    void store(uint64_t key, const Roads &roads) const;
+    void store(uint64_t key, const TrenchGraph &g) const;
+    void store(uint64_t key, const HDDGraph &g) const;
+
+private:
+    std::string path(const char *stage, uint64_t key) const;
+
+    std::string dir_;
+};
@@ -0,0 +1,16 @@
+#pragma once
+#include <string>
+#include "config.h"
+#include "graph.h"
+#include "hdd.h"
+#include "export.h"
+
+// Векторные тайлы (MVT) графа для веб-карты: <base>_tiles/{z}/{x}/{y}.pbf для зумов
+// cfg.tile_min_zoom..cfg.tile_max_zoom и <base>_tiles/metadata.json.
+// Слои: trench, trench_nodes, hdd, transitions. На максимальном зуме - все рёбра и узлы как есть;
+// ниже - цепочки траншей через узлы степени 2 склеиваются в линии и прореживаются до пикселя,
+// остаются только узлы степени != 2, поперечные рёбра ГНБ с концами в одних ячейках
+// сливаются в одно (свойство count), переходы не выводятся.
+// Тайлы кодируются параллельно. Возвращает число записанных тайлов.
+int write_tiles(const std::string &base, const Config &cfg, const TrenchGraph &trench, const HDDGraph &hdd,
+                const Region *region = nullptr, int threads = 0);
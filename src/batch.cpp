@@ -0,0 +1,112 @@
+#include "batch.h"
+#include "io.h"
+#include "graph.h"
+#include "hdd.h"
+#include "export.h"
+#include "reorder.h"
+#include "parallel.h"
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <map>
+
+struct BatchGroup
+{
+    std::vector<int> configs;
+    TrenchGraph trench;
+    HDDGraph loose;
+};
+
+int run_batch(const Roads &roads, const Config &base, const std::string &configs_path, int threads)
+{
+    std::ifstream in(configs_path);
+    if (!in)
+    {
+        std::cerr << "Can't read batch file: " << configs_path << "\n";
+        return 2;
+    }
+
+    std::vector<Config> configs;
+    std::string line;
+    while (std::getline(in, line))
+    {
+        if (line.find_first_not_of(" \t\r") == std::string::npos)
+            continue;
+        Config cfg = base;
+        cfg.output_basename = base.output_basename + "_" + std::to_string(configs.size());
+        io::parse_config_text(line, cfg);
+        configs.push_back(cfg);
+    }
+    if (configs.empty())
+    {
+        std::cerr << "Batch file has no configs: " << configs_path << "\n";
+        return 2;
+    }
+
+    auto t0 = std::chrono::steady_clock::now();
+
+    // группы по параметрам траншей
+    std::map<std::tuple<std::string, double, std::string>, int> group_of;
+    std::vector<BatchGroup> groups;
+    for (int c = 0; c < (int)configs.size(); ++c)
+    {
+        auto key = std::make_tuple(configs[c].trench_mode, configs[c].boundary_step, configs[c].node_order);
+        auto it = group_of.find(key);
+        if (it == group_of.end())
+        {
+            it = group_of.emplace(key, (int)groups.size()).first;
+            groups.emplace_back();
+        }
+        groups[it->second].configs.push_back(c);
+    }
+
+    parallel_for((int)groups.size(), [&](int gi)
+                 {
+        auto &grp = groups[gi];
+        const Config &first = configs[grp.configs.front()];
+        grp.trench = first.trench_mode == "union" ? build_trench_union(roads, first.boundary_step)
+                                                  : build_trench_strict(roads, first.boundary_step);
+        reorder_trench_nodes(grp.trench, first.node_order);
+
+        HDDParams loose = make_hdd_params(first);
+        for (int c : grp.configs)
+        {
+            HDDParams p = make_hdd_params(configs[c]);
+            loose.cross_min = std::min(loose.cross_min, p.cross_min);
+            loose.cross_max = std::max(loose.cross_max, p.cross_max);
+            loose.cross_angle_tol_deg = std::max(loose.cross_angle_tol_deg, p.cross_angle_tol_deg);
+        }
+        loose.min_alpha_over_roads = grp.configs.size() > 1;
+        grp.loose = build_hdd_from_trench(roads, grp.trench.nodes, grp.trench.edges, loose); }, threads);
+
+    auto t1 = std::chrono::steady_clock::now();
+
+    std::vector<int> owner(configs.size());
+    for (int gi = 0; gi < (int)groups.size(); ++gi)
+        for (int c : groups[gi].configs)
+            owner[c] = gi;
+
+    std::vector<size_t> hdd_edges(configs.size());
+    parallel_for((int)configs.size(), [&](int c)
+                 {
+        const Config &cfg = configs[c];
+        const auto &grp = groups[owner[c]];
+        HDDGraph hdd = filter_hdd(grp.loose, make_hdd_params(cfg));
+        hdd_edges[c] = hdd.edges.size();
+        // конфиги уже идут параллельно, тайлы внутри одного - в одном потоке
+        write_graph(cfg.output_basename, cfg, grp.trench, hdd, nullptr, 1); }, threads);
+
+    auto t2 = std::chrono::steady_clock::now();
+
+    for (int c = 0; c < (int)configs.size(); ++c)
+    {
+        const auto &grp = groups[owner[c]];
+        std::cout << configs[c].output_basename << ": trench nodes=" << grp.trench.nodes.size()
+                  << ", edges=" << grp.trench.edges.size() << ", hdd edges=" << hdd_edges[c] << "\n";
+    }
+    auto ms = [](auto a, auto b)
+    { return std::chrono::duration<double, std::milli>(b - a).count(); };
+    std::cout << "Batch: configs=" << configs.size() << ", trench builds=" << groups.size()
+              << ", build " << ms(t0, t1) << " ms, filter+write " << ms(t1, t2) << " ms\n";
+    return 0;
+}
@@ -0,0 +1,65 @@
+#include "box_grid.h"
+#include <algorithm>
+#include <cmath>
+
+BoxGrid::Box BoxGrid::box_of(const std::vector<Pt> &pts)
+{
+    Box b{INFINITY, INFINITY, -INFINITY, -INFINITY};
+    for (const auto &p : pts)
+    {
+        b.x0 = std::min(b.x0, p.x);
+        b.y0 = std::min(b.y0, p.y);
+        b.x1 = std::max(b.x1, p.x);
+        b.y1 = std::max(b.y1, p.y);
+    }
+    return b;
+}
+
+long long BoxGrid::ix(double v) const
+{
+    return (long long)std::floor(v / cell_);
+}
+
+void BoxGrid::build(const std::vector<Box> &boxes)
+{
+    cells_.clear();
+    big_.clear();
+    count_ = boxes.size();
+    cell_ = 1.0;
+    double sum = 0.0;
+    for (const auto &b : boxes)
+        sum += std::max(b.x1 - b.x0, b.y1 - b.y0);
+    if (!boxes.empty())
+        cell_ = std::max(1.0, sum / boxes.size());
+
+    for (int i = 0; i < (int)boxes.size(); ++i)
+    {
+        const Box &b = boxes[i];
+        if (!(b.x0 <= b.x1 && b.y0 <= b.y1))
+            continue; // пустой объект
+        long long x0 = ix(b.x0), x1 = ix(b.x1), y0 = ix(b.y0), y1 = ix(b.y1);
+        if ((x1 - x0 + 1) * (y1 - y0 + 1) > 4096)
+        {
+            big_.push_back(i);
+            continue;
+        }
+        for (long long x = x0; x <= x1; ++x)
+            for (long long y = y0; y <= y1; ++y)
+                cells_[key(x, y)].push_back(i);
+    }
+}
+
+void BoxGrid::query(const Box &b, std::vector<int> &out) const
+{
+    out = big_;
+    long long x0 = ix(b.x0), x1 = ix(b.x1), y0 = ix(b.y0), y1 = ix(b.y1);
+    for (long long x = x0; x <= x1; ++x)
+        for (long long y = y0; y <= y1; ++y)
+        {
+            auto it = cells_.find(key(x, y));
+            if (it != cells_.end())
+                out.insert(out.end(), it->second.begin(), it->second.end());
+        }
+    std::sort(out.begin(), out.end());
+    out.erase(std::unique(out.begin(), out.end()), out.end());
+}
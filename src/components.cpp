@@ -0,0 +1,153 @@
+#include "components.h"
+#include "parallel.h"
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <memory>
+
+// Корень с сокращением пути вдвое; родитель у корня - он сам, у остальных - меньший номер
+static int uf_find(std::atomic<int> *parent, int x)
+{
+    while (true)
+    {
+        int p = parent[x].load(std::memory_order_relaxed);
+        if (p == x)
+            return x;
+        int gp = parent[p].load(std::memory_order_relaxed);
+        if (gp != p)
+            parent[x].compare_exchange_weak(p, gp, std::memory_order_relaxed);
+        x = gp;
+    }
+}
+
+static void uf_unite(std::atomic<int> *parent, int a, int b)
+{
+    while (true)
+    {
+        a = uf_find(parent, a);
+        b = uf_find(parent, b);
+        if (a == b)
+            return;
+        if (a > b)
+            std::swap(a, b);
+        // больший корень подвешивается к меньшему, если он всё ещё корень
+        int expected = b;
+        if (parent[b].compare_exchange_strong(expected, a, std::memory_order_acq_rel))
+            return;
+    }
+}
+
+Components connected_components(const std::vector<Pt> &nodes, const std::vector<std::pair<int, int>> &edges,
+                                int threads)
+{
+    const int N = (int)nodes.size();
+    std::unique_ptr<std::atomic<int>[]> parent(new std::atomic<int>[N]);
+    for (int i = 0; i < N; ++i)
+        parent[i].store(i, std::memory_order_relaxed);
+
+    const int CHUNK = 4096;
+    const int E = (int)edges.size();
+    parallel_for((E + CHUNK - 1) / CHUNK, [&](int c)
+                 {
+        for (int e = c * CHUNK; e < std::min(E, (c + 1) * CHUNK); ++e)
+            uf_unite(parent.get(), edges[e].first, edges[e].second); }, threads);
+
+    Components out;
+    out.of.resize(N);
+    parallel_for((N + CHUNK - 1) / CHUNK, [&](int c)
+                 {
+        for (int i = c * CHUNK; i < std::min(N, (c + 1) * CHUNK); ++i)
+            out.of[i] = uf_find(parent.get(), i); }, threads);
+
+    // корень - наименьший узел компоненты, так что номера идут по порядку узлов
+    std::vector<int> id(N, -1);
+    for (int i = 0; i < N; ++i)
+    {
+        int r = out.of[i];
+        if (id[r] < 0)
+        {
+            id[r] = out.count();
+            out.nodes.push_back(0);
+            out.length.push_back(0.0);
+        }
+        out.of[i] = id[r];
+        out.nodes[id[r]]++;
+    }
+    for (auto [u, v] : edges)
+        out.length[out.of[u]] += norm(nodes[v] - nodes[u]);
+    return out;
+}
+
+std::string components_summary(const Components &c)
+{
+    if (c.count() == 0)
+        return "0";
+    std::vector<int> sizes = c.nodes;
+    std::sort(sizes.begin(), sizes.end());
+    int singletons = (int)(std::upper_bound(sizes.begin(), sizes.end(), 1) - sizes.begin());
+    int small = (int)(std::lower_bound(sizes.begin(), sizes.end(), 10) - sizes.begin());
+    char buf[160];
+    std::snprintf(buf, sizeof(buf), "%d (largest %d nodes, median %d, single nodes %d, under 10 nodes %d)",
+                  c.count(), sizes.back(), sizes[sizes.size() / 2], singletons, small);
+    return buf;
+}
+
+int prune_components(TrenchGraph &trench, HDDGraph &hdd, const Components &c, int min_nodes, double min_length)
+{
+    std::vector<char> drop(c.count(), 0);
+    int dropped = 0;
+    for (int k = 0; k < c.count(); ++k)
+    {
+        drop[k] = (min_nodes > 0 && c.nodes[k] < min_nodes) || (min_length > 0.0 && c.length[k] < min_length);
+        dropped += drop[k];
+    }
+    if (!dropped)
+        return 0;
+
+    // новые номера узлов ГНБ и траншей
+    std::vector<int> hmap(hdd.nodes.size(), -1), tmap(trench.nodes.size(), -1);
+    std::vector<Pt> hnodes, tnodes;
+    for (size_t i = 0; i < hdd.nodes.size(); ++i)
+        if (!drop[c.of[i]])
+        {
+            hmap[i] = (int)hnodes.size();
+            hnodes.push_back(hdd.nodes[i]);
+        }
+    std::vector<int> t2h;
+    for (size_t i = 0; i < trench.nodes.size(); ++i)
+    {
+        int h = i < hdd.trench_to_hdd.size() ? hdd.trench_to_hdd[i] : -1;
+        if (h >= 0 && hmap[h] < 0)
+            continue;
+        tmap[i] = (int)tnodes.size();
+        tnodes.push_back(trench.nodes[i]);
+        t2h.push_back(h >= 0 ? hmap[h] : -1);
+    }
+
+    std::vector<std::pair<int, int>> tedges;
+    for (auto [u, v] : trench.edges)
+        if (tmap[u] >= 0 && tmap[v] >= 0)
+            tedges.emplace_back(tmap[u], tmap[v]);
+
+    std::vector<std::pair<int, int>> hedges;
+    std::vector<double> alpha;
+    int trench_count = 0;
+    for (size_t e = 0; e < hdd.edges.size(); ++e)
+    {
+        auto [u, v] = hdd.edges[e];
+        if (hmap[u] < 0 || hmap[v] < 0)
+            continue;
+        hedges.emplace_back(hmap[u], hmap[v]);
+        alpha.push_back(e < hdd.edge_alpha.size() ? hdd.edge_alpha[e] : 0.0);
+        trench_count += (int)e < hdd.trench_edge_count;
+    }
+
+    trench.nodes = std::move(tnodes);
+    trench.edges = std::move(tedges);
+    hdd.nodes = std::move(hnodes);
+    hdd.edges = std::move(hedges);
+    hdd.edge_alpha = std::move(alpha);
+    hdd.trench_to_hdd = std::move(t2h);
+    hdd.trench_edge_count = trench_count;
+    return dropped;
+}
@@ -0,0 +1,212 @@
+#include "export.h"
+#include "geojson_writer.h"
+#include "fgb_writer.h"
+#include "tiles.h"
+#include "components.h"
+#include "memtrack.h"
+#include <fstream>
+
+void save_text(const std::string &path, const std::string &data)
+{
+    std::ofstream f(path, std::ios::binary);
+    f << data;
+}
+
+const char *output_ext(const Config &cfg)
+{
+    return cfg.output_format == "fgb" ? ".fgb" : ".geojson";
+}
+
+std::map<std::string, std::string> node_props(const char *type, size_t id)
+{
+    return {{"type", type}, {"id", std::to_string(id)}};
+}
+
+std::map<std::string, std::string> edge_props(const char *type, double length, double price_per_m)
+{
+    return {{"type", type},
+            {"length", std::to_string(length)},
+            {"cost", std::to_string(length * price_per_m)}};
+}
+
+std::map<std::string, std::string> transition_props(const Config &cfg)
+{
+    return {{"type", "transition"},
+            {"length", "0"},
+            {"cost", std::to_string(cfg.transition_per_edge)}};
+}
+
+static bool keep_node(const Region *region, const Pt &p)
+{
+    return !region || region->contains(p);
+}
+
+static bool keep_edge(const Region *region, const Pt &a, const Pt &b)
+{
+    return !region || region->contains(a) || region->contains(b);
+}
+
+// Writer - gj::Writer или fgb::Writer
+template <class Writer>
+static std::string nodes_as(const std::string &layer, const char *type, const std::vector<Pt> &nodes,
+                            const Region *region)
+{
+    Writer w;
+    {
+        memtrack::Tag tag("feature strings");
+        for (size_t i = 0; i < nodes.size(); ++i)
+        {
+            if (!keep_node(region, nodes[i]))
+                continue;
+            w.add_point(nodes[i].x, nodes[i].y, node_props(type, i));
+        }
+    }
+    memtrack::Tag tag("file text");
+    return w.finish(layer);
+}
+
+template <class Writer>
+static std::string edges_as(const std::string &layer, const char *type, const std::vector<Pt> &nodes,
+                            const std::vector<std::pair<int, int>> &edges, double price_per_m, const Region *region)
+{
+    Writer w;
+    {
+        memtrack::Tag tag("feature strings");
+        for (auto [u, v] : edges)
+        {
+            if (!keep_edge(region, nodes[u], nodes[v]))
+                continue;
+            std::vector<Pt> line{nodes[u], nodes[v]};
+            w.add_line(line, edge_props(type, norm(nodes[v] - nodes[u]), price_per_m));
+        }
+    }
+    memtrack::Tag tag("file text");
+    return w.finish(layer);
+}
+
+template <class Writer>
+static std::string transitions_as(const Config &cfg, const TrenchGraph &trench, const Region *region, int &transitions)
+{
+    Writer w;
+    transitions = 0;
+    memtrack::Tag tag("feature strings");
+    for (size_t i = 0; i < trench.nodes.size(); ++i)
+    {
+        const Pt &p = trench.nodes[i];
+        if (!keep_node(region, p))
+            continue;
+        // std::vector<Pt> zero{p, p}; // нулевая длина и ненулевая стоимость
+        // w.add_line(zero, {{"type", "transition"},
+        //                   {"length", "0"},
+        //                   {"cost", std::to_string(cfg.transition_per_edge)}});
+        w.add_point(p.x, p.y, transition_props(cfg)); // так их видно
+        ++transitions;
+    }
+    return w.finish("edges_transition");
+}
+
+static OutputFile nodes_file(const std::string &base, const Config &cfg, const char *layer, const char *type,
+                             const std::vector<Pt> &nodes, const Region *region)
+{
+    OutputFile f{base + "_" + layer + output_ext(cfg), {}};
+    f.data = cfg.output_format == "fgb" ? nodes_as<fgb::Writer>(layer, type, nodes, region)
+                                        : nodes_as<gj::Writer>(layer, type, nodes, region);
+    return f;
+}
+
+static OutputFile edges_file(const std::string &base, const Config &cfg, const char *layer, const char *type,
+                             const std::vector<Pt> &nodes, const std::vector<std::pair<int, int>> &edges,
+                             double price_per_m, const Region *region)
+{
+    OutputFile f{base + "_" + layer + output_ext(cfg), {}};
+    f.data = cfg.output_format == "fgb" ? edges_as<fgb::Writer>(layer, type, nodes, edges, price_per_m, region)
+                                        : edges_as<gj::Writer>(layer, type, nodes, edges, price_per_m, region);
+    return f;
+}
+
+OutputFile format_trench_nodes(const std::string &base, const Config &cfg, const TrenchGraph &trench,
+                               const Region *region)
+{
+    return nodes_file(base, cfg, "nodes_trench", "trench", trench.nodes, region);
+}
+
+OutputFile format_trench_edges(const std::string &base, const Config &cfg, const TrenchGraph &trench,
+                               const Region *region)
+{
+    return edges_file(base, cfg, "edges_trench", "trench", trench.nodes, trench.edges, cfg.trench_per_m, region);
+}
+
+OutputFile format_hdd_nodes(const std::string &base, const Config &cfg, const HDDGraph &hdd,
+                            const Region *region)
+{
+    return nodes_file(base, cfg, "nodes_hdd", "hdd", hdd.nodes, region);
+}
+
+OutputFile format_hdd_edges(const std::string &base, const Config &cfg, const HDDGraph &hdd,
+                            const Region *region)
+{
+    return edges_file(base, cfg, "edges_hdd", "hdd", hdd.nodes, hdd.edges, cfg.hdd_per_m, region);
+}
+
+OutputFile format_transitions(const std::string &base, const Config &cfg, const TrenchGraph &trench,
+                              const Region *region, int *count)
+{
+    OutputFile f{base + "_edges_transition" + output_ext(cfg), {}};
+    int transitions = 0;
+    f.data = cfg.output_format == "fgb" ? transitions_as<fgb::Writer>(cfg, trench, region, transitions)
+                                        : transitions_as<gj::Writer>(cfg, trench, region, transitions);
+    if (count)
+        *count = transitions;
+    return f;
+}
+
+static void save(const OutputFile &f)
+{
+    save_text(f.path, f.data);
+}
+
+void write_trench(const std::string &base, const Config &cfg, const TrenchGraph &trench,
+                  const Region *region)
+{
+    save(format_trench_nodes(base, cfg, trench, region));
+    save(format_trench_edges(base, cfg, trench, region));
+}
+
+void write_hdd(const std::string &base, const Config &cfg, const HDDGraph &hdd,
+               const Region *region)
+{
+    save(format_hdd_nodes(base, cfg, hdd, region));
+    save(format_hdd_edges(base, cfg, hdd, region));
+}
+
+int write_transitions(const std::string &base, const Config &cfg, const TrenchGraph &trench,
+                      const Region *region)
+{
+    int transitions = 0;
+    save(format_transitions(base, cfg, trench, region, &transitions));
+    return transitions;
+}
+
+void write_graph(const std::string &base, const Config &cfg, const TrenchGraph &trench, const HDDGraph &hdd,
+                 const Region *region, int threads)
+{
+    if (cfg.prune_min_nodes > 0 || cfg.prune_min_length > 0.0)
+    {
+        TrenchGraph t = trench;
+        HDDGraph h = hdd;
+        prune_components(t, h, connected_components(h.nodes, h.edges, threads), cfg.prune_min_nodes, cfg.prune_min_length);
+        Config plain = cfg;
+        plain.prune_min_nodes = 0;
+        plain.prune_min_length = 0.0;
+        write_graph(base, plain, t, h, region, threads);
+        return;
+    }
+    if (cfg.output_format == "mvt")
+    {
+        write_tiles(base, cfg, trench, hdd, region, threads);
+        return;
+    }
+    write_trench(base, cfg, trench, region);
+    write_hdd(base, cfg, hdd, region);
+    write_transitions(base, cfg, trench, region);
+}
@@ -0,0 +1,409 @@
+#include "fgb_writer.h"
+#include "hilbert.h"
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+
+using namespace std;
+
+namespace fgb
+{
+
+    // Минимальный построитель flatbuffers: буфер растёт от конца к началу, как в официальной
+    // библиотеке, поэтому дочерние объекты пишутся раньше ссылающихся на них таблиц.
+    // Смещения (uoffset) отсчитываются от конца буфера.
+    class FlatBuilder
+    {
+    public:
+        uint32_t size() const { return (uint32_t)(buf_.size() - head_); }
+
+        template <class T>
+        void push(T v)
+        {
+            reserve(sizeof(T));
+            head_ -= sizeof(T);
+            memcpy(&buf_[head_], &v, sizeof(T));
+        }
+
+        // выравнивание так, чтобы после записи len байт размер был кратен a
+        void prealign(size_t len, size_t a)
+        {
+            minalign_ = std::max(minalign_, a);
+            size_t pad = (a - (size() + len) % a) % a;
+            reserve(pad);
+            head_ -= pad;
+            memset(&buf_[head_], 0, pad);
+        }
+
+        uint32_t string(const std::string &s)
+        {
+            prealign(s.size() + 1, 4);
+            push<uint8_t>(0);
+            bytes(s.data(), s.size());
+            push<uint32_t>((uint32_t)s.size());
+            return size();
+        }
+
+        template <class T>
+        uint32_t vector(const T *v, size_t n)
+        {
+            prealign(n * sizeof(T), 4);
+            prealign(n * sizeof(T), sizeof(T));
+            bytes(v, n * sizeof(T));
+            push<uint32_t>((uint32_t)n);
+            return size();
+        }
+
+        uint32_t offsets(const std::vector<uint32_t> &refs)
+        {
+            prealign(refs.size() * 4, 4);
+            for (size_t i = refs.size(); i-- > 0;)
+                push<uint32_t>(size() + 4 - refs[i]);
+            push<uint32_t>((uint32_t)refs.size());
+            return size();
+        }
+
+        void start_table()
+        {
+            fields_.clear();
+            table_start_ = size();
+        }
+
+        template <class T>
+        void field(int id, T v)
+        {
+            prealign(sizeof(T), sizeof(T));
+            push(v);
+            fields_.emplace_back(id, size());
+        }
+
+        void field_ref(int id, uint32_t ref)
+        {
+            prealign(4, 4);
+            push<uint32_t>(size() + 4 - ref);
+            fields_.emplace_back(id, size());
+        }
+
+        uint32_t end_table()
+        {
+            prealign(4, 4);
+            push<int32_t>(0);
+            uint32_t table = size();
+
+            int n = 0;
+            for (auto &f : fields_)
+                n = std::max(n, f.first + 1);
+            std::vector<uint16_t> vt(n, 0);
+            for (auto &f : fields_)
+                vt[f.first] = (uint16_t)(table - f.second);
+            for (int i = n; i-- > 0;)
+                push<uint16_t>(vt[i]);
+            push<uint16_t>((uint16_t)(table - table_start_));
+            push<uint16_t>((uint16_t)(4 + 2 * n));
+
+            int32_t soff = (int32_t)(size() - table);
+            memcpy(&buf_[buf_.size() - table], &soff, 4);
+            return table;
+        }
+
+        // корень с префиксом размера; результат - байты буфера от начала
+        std::string finish(uint32_t root)
+        {
+            prealign(8, minalign_);
+            push<uint32_t>(size() + 4 - root);
+            push<uint32_t>(size());
+            return std::string((const char *)&buf_[head_], size());
+        }
+
+    private:
+        std::vector<uint8_t> buf_;
+        size_t head_ = 0;
+        size_t minalign_ = 4;
+        uint32_t table_start_ = 0;
+        std::vector<std::pair<int, uint32_t>> fields_;
+
+        void reserve(size_t n)
+        {
+            if (head_ >= n)
+                return;
+            size_t used = size();
+            size_t cap = std::max(buf_.size() * 2, used + n + 256);
+            std::vector<uint8_t> nb(cap);
+            memcpy(nb.data() + cap - used, buf_.data() + head_, used);
+            buf_.swap(nb);
+            head_ = cap - used;
+        }
+
+        void bytes(const void *p, size_t n)
+        {
+            reserve(n);
+            head_ -= n;
+            if (n)
+                memcpy(&buf_[head_], p, n);
+        }
+    };
+
+    // Значения перечислений и номера полей из header.fbs / feature.fbs
+    enum : uint8_t
+    {
+        GEOM_UNKNOWN = 0,
+        GEOM_POINT = 1,
+        GEOM_LINESTRING = 2
+    };
+    enum : uint8_t
+    {
+        COL_LONG = 7,
+        COL_DOUBLE = 10,
+        COL_STRING = 11
+    };
+
+    static const uint8_t MAGIC[8] = {'f', 'g', 'b', 3, 'f', 'g', 'b', 0};
+    static const uint16_t NODE_SIZE = 16;
+
+    struct NodeItem
+    {
+        double x0, y0, x1, y1;
+        uint64_t offset;
+    };
+
+    void Writer::add(bool line, const Pt *p, size_t n, const map<string, string> &props)
+    {
+        Rec r{line, pts.size(), n, vals.size(), props.size()};
+        pts.insert(pts.end(), p, p + n);
+        for (const auto &kv : props)
+        {
+            int c = int(std::find(columns.begin(), columns.end(), kv.first) - columns.begin());
+            if (c == (int)columns.size())
+                columns.push_back(kv.first);
+            vals.emplace_back(c, kv.second);
+        }
+        recs.push_back(r);
+    }
+
+    void Writer::add_point(double x, double y, const map<string, string> &props)
+    {
+        Pt p{x, y};
+        add(false, &p, 1, props);
+    }
+
+    void Writer::add_line(const vector<Pt> &line, const map<string, string> &props)
+    {
+        if (line.size() < 2)
+            return;
+        add(true, line.data(), line.size(), props);
+    }
+
+    static bool parses_as_long(const string &s)
+    {
+        if (s.empty())
+            return false;
+        char *end = nullptr;
+        strtoll(s.c_str(), &end, 10);
+        return *end == '\0';
+    }
+
+    static bool parses_as_double(const string &s)
+    {
+        if (s.empty())
+            return false;
+        char *end = nullptr;
+        strtod(s.c_str(), &end);
+        return *end == '\0';
+    }
+
+    template <class T>
+    static void append_raw(string &o, T v)
+    {
+        o.append((const char *)&v, sizeof(T));
+    }
+
+    std::string Writer::finish(const std::string &layer_name) const
+    {
+        // типы колонок: самый узкий, в который помещаются все значения
+        vector<uint8_t> col_type(columns.size(), COL_LONG);
+        for (const auto &[c, v] : vals)
+        {
+            if (col_type[c] == COL_LONG && !parses_as_long(v))
+                col_type[c] = COL_DOUBLE;
+            if (col_type[c] == COL_DOUBLE && !parses_as_double(v))
+                col_type[c] = COL_STRING;
+        }
+
+        bool any_point = false, any_line = false;
+        const double INF = numeric_limits<double>::infinity();
+        double ex0 = INF, ey0 = INF, ex1 = -INF, ey1 = -INF;
+        size_t N = recs.size();
+        vector<NodeItem> boxes(N);
+        for (size_t i = 0; i < N; ++i)
+        {
+            const Rec &r = recs[i];
+            (r.line ? any_line : any_point) = true;
+            NodeItem b{INF, INF, -INF, -INF, 0};
+            for (size_t k = r.first_pt; k < r.first_pt + r.n_pts; ++k)
+            {
+                b.x0 = std::min(b.x0, pts[k].x);
+                b.y0 = std::min(b.y0, pts[k].y);
+                b.x1 = std::max(b.x1, pts[k].x);
+                b.y1 = std::max(b.y1, pts[k].y);
+            }
+            boxes[i] = b;
+            ex0 = std::min(ex0, b.x0);
+            ey0 = std::min(ey0, b.y0);
+            ex1 = std::max(ex1, b.x1);
+            ey1 = std::max(ey1, b.y1);
+        }
+        uint8_t layer_type = any_point && any_line ? GEOM_UNKNOWN : any_line ? GEOM_LINESTRING
+                                                                               : GEOM_POINT;
+
+        // порядок фич - по убыванию номера центра рамки на кривой Гильберта
+        vector<uint32_t> hv(N);
+        for (size_t i = 0; i < N; ++i)
+            hv[i] = hilbert_index((boxes[i].x0 + boxes[i].x1) / 2, (boxes[i].y0 + boxes[i].y1) / 2,
+                                  ex0, ey0, ex1 - ex0, ey1 - ey0);
+        vector<size_t> order(N);
+        for (size_t i = 0; i < N; ++i)
+            order[i] = i;
+        std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b)
+                         { return hv[a] > hv[b]; });
+
+        // фичи: размер + Feature{geometry: Geometry{xy, type}, properties}
+        string features;
+        vector<NodeItem> leaves(N);
+        vector<double> xy;
+        string props;
+        for (size_t k = 0; k < N; ++k)
+        {
+            const Rec &r = recs[order[k]];
+            leaves[k] = boxes[order[k]];
+            leaves[k].offset = features.size();
+
+            props.clear();
+            for (size_t v = r.first_val; v < r.first_val + r.n_vals; ++v)
+            {
+                const auto &[c, s] = vals[v];
+                append_raw<uint16_t>(props, (uint16_t)c);
+                if (col_type[c] == COL_LONG)
+                    append_raw<int64_t>(props, strtoll(s.c_str(), nullptr, 10));
+                else if (col_type[c] == COL_DOUBLE)
+                    append_raw<double>(props, strtod(s.c_str(), nullptr));
+                else
+                {
+                    append_raw<uint32_t>(props, (uint32_t)s.size());
+                    props += s;
+                }
+            }
+
+            xy.clear();
+            for (size_t p = r.first_pt; p < r.first_pt + r.n_pts; ++p)
+            {
+                xy.push_back(pts[p].x);
+                xy.push_back(pts[p].y);
+            }
+
+            FlatBuilder fb;
+            uint32_t xy_ref = fb.vector(xy.data(), xy.size());
+            fb.start_table();
+            fb.field_ref(1, xy_ref);
+            if (layer_type == GEOM_UNKNOWN) // иначе тип берётся из заголовка
+                fb.field<uint8_t>(6, r.line ? GEOM_LINESTRING : GEOM_POINT);
+            uint32_t geom = fb.end_table();
+            uint32_t props_ref = fb.vector((const uint8_t *)props.data(), props.size());
+            fb.start_table();
+            fb.field_ref(0, geom);
+            fb.field_ref(1, props_ref);
+            features += fb.finish(fb.end_table());
+        }
+
+        // упакованное R-дерево: уровни хранятся от корня к листьям, листья - в порядке фич
+        string index;
+        if (N > 0)
+        {
+            vector<size_t> level_size{N};
+            size_t total = N;
+            for (size_t n = N; n != 1;)
+            {
+                n = (n + NODE_SIZE - 1) / NODE_SIZE;
+                level_size.push_back(n);
+                total += n;
+            }
+            vector<size_t> level_begin(level_size.size());
+            size_t off = total;
+            for (size_t l = 0; l < level_size.size(); ++l)
+                level_begin[l] = off -= level_size[l];
+
+            vector<NodeItem> nodes(total);
+            std::copy(leaves.begin(), leaves.end(), nodes.begin() + level_begin[0]);
+            for (size_t l = 0; l + 1 < level_size.size(); ++l)
+            {
+                size_t pos = level_begin[l], end = pos + level_size[l], out = level_begin[l + 1];
+                while (pos < end)
+                {
+                    NodeItem p{INF, INF, -INF, -INF, pos};
+                    for (size_t j = 0; j < NODE_SIZE && pos < end; ++j, ++pos)
+                    {
+                        p.x0 = std::min(p.x0, nodes[pos].x0);
+                        p.y0 = std::min(p.y0, nodes[pos].y0);
+                        p.x1 = std::max(p.x1, nodes[pos].x1);
+                        p.y1 = std::max(p.y1, nodes[pos].y1);
+                    }
+                    nodes[out++] = p;
+                }
+            }
+            index.reserve(total * 40);
+            for (const auto &n : nodes)
+            {
+                append_raw(index, n.x0);
+                append_raw(index, n.y0);
+                append_raw(index, n.x1);
+                append_raw(index, n.y1);
+                append_raw(index, n.offset);
+            }
+        }
+
+        // заголовок
+        FlatBuilder fb;
+        vector<uint32_t> cols;
+        for (size_t c = 0; c < columns.size(); ++c)
+        {
+            uint32_t name = fb.string(columns[c]);
+            fb.start_table();
+            fb.field_ref(0, name);
+            fb.field<uint8_t>(1, col_type[c]);
+            cols.push_back(fb.end_table());
+        }
+        uint32_t cols_ref = fb.offsets(cols);
+        uint32_t org = fb.string("EPSG");
+        fb.start_table();
+        fb.field_ref(0, org);
+        fb.field<int32_t>(1, crs_code);
+        uint32_t crs = fb.end_table();
+        uint32_t env = 0;
+        if (N > 0)
+        {
+            double e[4] = {ex0, ey0, ex1, ey1};
+            env = fb.vector(e, 4);
+        }
+        uint32_t name = fb.string(layer_name);
+        fb.start_table();
+        fb.field<uint64_t>(8, (uint64_t)N);
+        fb.field_ref(0, name);
+        if (N > 0)
+            fb.field_ref(1, env);
+        fb.field_ref(7, cols_ref);
+        fb.field_ref(10, crs);
+        fb.field<uint16_t>(9, N > 0 ? NODE_SIZE : 0);
+        fb.field<uint8_t>(2, layer_type);
+        string header = fb.finish(fb.end_table());
+
+        string o;
+        o.reserve(8 + header.size() + index.size() + features.size());
+        o.append((const char *)MAGIC, 8);
+        o += header;
+        o += index;
+        o += features;
+        return o;
+    }
+
+}
@@ -1,94 +1,161 @@
 #include "geojson_writer.h"
-#include <sstream>
-#include <iomanip>
+#include "json_esc.h"
+#include <cstdio>
 
 using namespace std;
 
 namespace gj
 {
 
-    static string esc(const string &s)
+    // то же, что ostream с fixed и setprecision(6)
+    template <class S>
+    static void append_num(S &o, double v)
     {
-        string o;
-        o.reserve(s.size() + 16);
-        for (char c : s)
-        {
-            if (c == '"' || c == '\\')
-            {
-                o.push_back('\\');
-                o.push_back(c);
-            }
-            else if (c == '\n')
-                o += "\\n";
-            else
-                o.push_back(c);
-        }
-        return o;
+        char buf[64];
+        int n = snprintf(buf, sizeof(buf), "%.6f", v);
+        o.append(buf, n);
     }
 
-    void Writer::add_point(double x, double y, const map<string, string> &props)
+    template <class S>
+    static void append_props(S &o, const map<string, string> &props)
     {
-        ostringstream o;
-        o.setf(std::ios::fixed);
-        o << setprecision(6);
-        o << "{\"type\":\"Feature\",\"geometry\":{\"type\":\"Point\",\"coordinates\":["
-          << x << "," << y << "]},\"properties\":{";
+        o += "},\"properties\":{";
         bool first = true;
         for (const auto &kv : props)
         {
             if (!first)
-                o << ",";
+                o += ",";
             first = false;
-            o << "\"" << esc(kv.first) << "\":\"" << esc(kv.second) << "\"";
+            o += "\"";
+            append_esc(o, kv.first);
+            o += "\":\"";
+            append_esc(o, kv.second);
+            o += "\"";
         }
-        o << "}}";
-        features.push_back(o.str());
+        o += "}}";
     }
 
-    void Writer::add_line(const vector<Pt> &pts, const map<string, string> &props)
+    template <class S>
+    static void point_feature(S &o, double x, double y, const map<string, string> &props)
     {
-        if (pts.size() < 2)
-            return;
-        ostringstream o;
-        o.setf(std::ios::fixed);
-        o << setprecision(6);
-        o << "{\"type\":\"Feature\",\"geometry\":{\"type\":\"LineString\",\"coordinates\":[";
+        o += "{\"type\":\"Feature\",\"geometry\":{\"type\":\"Point\",\"coordinates\":[";
+        append_num(o, x);
+        o += ",";
+        append_num(o, y);
+        o += "]";
+        append_props(o, props);
+    }
+
+    template <class S>
+    static void line_feature(S &o, const vector<Pt> &pts, const map<string, string> &props)
+    {
+        o += "{\"type\":\"Feature\",\"geometry\":{\"type\":\"LineString\",\"coordinates\":[";
         for (size_t i = 0; i < pts.size(); ++i)
         {
             if (i)
-                o << ",";
-            o << "[" << pts[i].x << "," << pts[i].y << "]";
-        }
-        o << "]},\"properties\":{";
-        bool first = true;
-        for (const auto &kv : props)
-        {
-            if (!first)
-                o << ",";
-            first = false;
-            o << "\"" << esc(kv.first) << "\":\"" << esc(kv.second) << "\"";
+                o += ",";
+            o += "[";
+            append_num(o, pts[i].x);
+            o += ",";
+            append_num(o, pts[i].y);
+            o += "]";
         }
-        o << "}}";
-        features.push_back(o.str());
+        o += "]";
+        append_props(o, props);
+    }
+
+    void Writer::add_point(double x, double y, const map<string, string> &props)
+    {
+        scratch.clear();
+        point_feature(scratch, x, y, props);
+        features.emplace_back(scratch.data(), scratch.size(), arena.get());
     }
 
+    void Writer::add_line(const vector<Pt> &pts, const map<string, string> &props)
+    {
+        if (pts.size() < 2)
+            return;
+        scratch.clear();
+        line_feature(scratch, pts, props);
+        features.emplace_back(scratch.data(), scratch.size(), arena.get());
+    }
+
+    static void append_header(string &o, const string &layer_name, const string &crs_name)
+    {
+        o += "{\n  \"type\": \"FeatureCollection\",\n  \"name\": \"";
+        append_esc(o, layer_name);
+        o += "\",\n  \"crs\": {\"type\":\"name\",\"properties\":{\"name\":\"";
+        append_esc(o, crs_name);
+        o += "\"}},\n  \"features\": [\n";
+    }
+
+    static const char FOOTER[] = "\n  ]\n}";
+
     std::string Writer::finish(const std::string &layer_name) const
     {
-        ostringstream o;
-        o << "{\n"
-          << "  \"type\": \"FeatureCollection\",\n"
-          << "  \"name\": \"" << esc(layer_name) << "\",\n"
-          << "  \"crs\": {\"type\":\"name\",\"properties\":{\"name\":\""
-          << esc(crs_name) << "\"}},\n"
-          << "  \"features\": [\n";
+        size_t total = 256 + layer_name.size() + crs_name.size();
+        for (const auto &f : features)
+            total += f.size() + 6;
+
+        string o;
+        o.reserve(total);
+        append_header(o, layer_name, crs_name);
         for (size_t i = 0; i < features.size(); ++i)
         {
             if (i)
-                o << ",\n";
-            o << "    " << features[i];
+                o += ",\n";
+            o += "    ";
+            o.append(features[i].data(), features[i].size());
         }
-        o << "\n  ]\n}";
-        return o.str();
+        o += FOOTER;
+        return o;
+    }
+
+    StreamWriter::StreamWriter(const string &path, const string &layer_name, const string &crs_name)
+    {
+        f = fopen(path.c_str(), "wb");
+        append_header(buf, layer_name, crs_name);
+        if (f)
+            fwrite(buf.data(), 1, buf.size(), f);
+        buf.clear();
+    }
+
+    StreamWriter::~StreamWriter()
+    {
+        finish();
+    }
+
+    void StreamWriter::flush_feature()
+    {
+        if (f)
+            fwrite(buf.data(), 1, buf.size(), f);
+        buf.clear();
+        first = false;
+    }
+
+    void StreamWriter::add_point(double x, double y, const map<string, string> &props)
+    {
+        buf += first ? "    " : ",\n    ";
+        point_feature(buf, x, y, props);
+        flush_feature();
+    }
+
+    void StreamWriter::add_line(const vector<Pt> &pts, const map<string, string> &props)
+    {
+        if (pts.size() < 2)
+            return;
+        buf += first ? "    " : ",\n    ";
+        line_feature(buf, pts, props);
+        flush_feature();
+    }
+
+    void StreamWriter::finish()
+    {
+        if (!f)
+            return;
+        fputs(FOOTER, f);
+        fclose(f);
+        f = nullptr;
     }
 
 }
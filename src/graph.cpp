@@ -1,7 +1,12 @@
 #include "graph.h"
 #include "geometry.h"
+#include "outline.h"
+#include "arena.h"
+#include "parallel.h"
+#include "memtrack.h"
 #include <cmath>
 #include <algorithm>
+#include <tuple>
 #include <unordered_map>
 
 static bool inside_any_other(Pt p, const Roads &roads, int selfIdx)
@@ -10,52 +15,50 @@ static bool inside_any_other(Pt p, const Roads &roads, int selfIdx)
     {
         if (i == selfIdx)
             continue;
-        if (point_in_polygon(p, roads.polygons[i].ring))
+        if (polygon_contains(roads.polygons[i], p))
             return true;
     }
     return false;
 }
 
-static bool seg_crosses_other_roads(const Seg &s, const Roads &roads, int selfIdx)
+bool seg_crosses_road(const Seg &s, const Polygon &poly)
 {
     const double EPS_END = 1e-7;
     Pt d{s.b.x - s.a.x, s.b.y - s.a.y};
+    const auto &R = poly.ring;
 
-    for (int i = 0; i < (int)roads.polygons.size(); ++i)
+    int in_cnt = 0;
+    for (double t : {0.2, 0.4, 0.6, 0.8})
     {
-        if (i == selfIdx)
-            continue;
-        const auto &R = roads.polygons[i].ring;
+        Pt q{s.a.x + d.x * t, s.a.y + d.y * t};
+        if (polygon_contains(poly, q))
+            ++in_cnt;
+    }
+    if (in_cnt >= 2)
+        return true;
+
+    return for_each_ring_edge_near(poly, s, [&](int k)
+                                   {
+        Pt ip;
+        if (!seg_intersect(s, {R[k - 1], R[k]}, &ip))
+            return false;
+        return !(norm(ip - s.a) < EPS_END || norm(ip - s.b) < EPS_END); });
+}
 
-        int in_cnt = 0;
-        for (double t : {0.2, 0.4, 0.6, 0.8})
-        {
-            Pt q{s.a.x + d.x * t, s.a.y + d.y * t};
-            if (point_in_polygon(q, R))
-                ++in_cnt;
-        }
-        if (in_cnt >= 2)
+bool seg_crosses_other_roads(const Seg &s, const Roads &roads, int selfIdx)
+{
+    for (int i = 0; i < (int)roads.polygons.size(); ++i)
+        if (i != selfIdx && seg_crosses_road(s, roads.polygons[i]))
             return true;
-
-        for (size_t k = 1; k < R.size(); ++k)
-        {
-            Pt ip;
-            if (seg_intersect(s, {R[k - 1], R[k]}, &ip))
-            {
-                if (norm(ip - s.a) < EPS_END || norm(ip - s.b) < EPS_END)
-                    continue;
-                return true;
-            }
-        }
-    }
     return false;
 }
 
-std::vector<Pt> sample_ring(const std::vector<Pt> &ring, double h)
+template <class Out>
+static void sample_ring_into(const std::vector<Pt> &ring, double h, Out &out)
 {
-    std::vector<Pt> out;
+    out.clear();
     if (ring.size() < 2)
-        return out;
+        return;
     out.push_back(ring.front());
 
     auto seglen = [](Pt a, Pt b)
@@ -82,6 +85,12 @@ std::vector<Pt> sample_ring(const std::vector<Pt> &ring, double h)
                 out.push_back(p);
         }
     }
+}
+
+std::vector<Pt> sample_ring(const std::vector<Pt> &ring, double h)
+{
+    std::vector<Pt> out;
+    sample_ring_into(ring, h, out);
     return out;
 }
 
@@ -92,7 +101,10 @@ static inline long long node_key_mm(Pt p)
     return (X << 21) ^ Y;
 }
 
-static int add_node_dedup(TrenchGraph &g, std::unordered_map<long long, int> &index, Pt p)
+// в куче, а не в арене: перестройки таблицы в монотонной арене оставляли бы старые массивы корзин
+using NodeIndex = std::unordered_map<long long, int>;
+
+static int add_node_dedup(TrenchGraph &g, NodeIndex &index, Pt p)
 {
     long long k = node_key_mm(p);
     auto it = index.find(k);
@@ -122,20 +134,44 @@ struct Hit
     Pt p;
 };
 
-static std::vector<std::vector<std::vector<Hit>>>
-collect_cross_hits(const std::vector<std::vector<Pt>> &sampled)
+// Точки пересечений всех сегментов всех полигонов в одном массиве (CSR):
+// точки сегмента seg полигона poly лежат в hits[seg_begin[poly_first[poly] + seg] .. seg_begin[... + 1])
+struct HitStore
+{
+    avector<Hit> hits;
+    avector<int> seg_begin;
+    avector<int> poly_first;
+
+    explicit HitStore(std::pmr::memory_resource *mr) : hits(mr), seg_begin(mr), poly_first(mr) {}
+
+    const Hit *begin(int poly, int seg) const { return hits.data() + seg_begin[poly_first[poly] + seg]; }
+    const Hit *end(int poly, int seg) const { return hits.data() + seg_begin[poly_first[poly] + seg + 1]; }
+    size_t count(int poly, int seg) const { return end(poly, seg) - begin(poly, seg); }
+};
+
+static HitStore collect_cross_hits(const avector<avector<Pt>> &sampled, std::pmr::memory_resource *mr)
 {
     const double EPS_END = 1e-7;
     int N = (int)sampled.size();
-    std::vector<std::vector<std::vector<Hit>>> hits(N);
+    HitStore store(mr);
 
+    store.poly_first.resize(N + 1);
+    int total = 0;
     for (int a = 0; a < N; ++a)
     {
+        store.poly_first[a] = total;
         int na = (int)sampled[a].size();
-        if (na < 2)
-            continue;
-        hits[a].assign(na, {});
+        if (na >= 2)
+            total += na;
     }
+    store.poly_first[N] = total;
+
+    struct Rec
+    {
+        int seg;
+        Hit h;
+    };
+    std::vector<Rec> recs; // растёт по ходу - в куче, в арену идут только итоговые массивы
 
     for (int a = 0; a < N; ++a)
     {
@@ -170,64 +206,94 @@ collect_cross_hits(const std::vector<std::vector<Pt>> &sampled)
                         continue;
 
                     if (!at_end_a)
-                        hits[a][i].push_back({ta, ip});
+                        recs.push_back({store.poly_first[a] + i, {ta, ip}});
                     if (!at_end_b)
-                        hits[b][j].push_back({tb, ip});
+                        recs.push_back({store.poly_first[b] + j, {tb, ip}});
                 }
             }
         }
     }
 
+    // подсчёт, затем раскладка по сегментам (порядок внутри сегмента сохраняется)
+    avector<int> &off = store.seg_begin;
+    off.assign(total + 1, 0);
+    for (const auto &r : recs)
+        off[r.seg + 1]++;
+    for (int s = 0; s < total; ++s)
+        off[s + 1] += off[s];
+
+    store.hits.resize(recs.size());
+    {
+        avector<int> pos(off.begin(), off.end() - 1, mr);
+        for (const auto &r : recs)
+            store.hits[pos[r.seg]++] = r.h;
+    }
+
+    // сортировка по t и слияние близких точек на месте, со сжатием массива
     const double EPS_MERGE = 1e-6;
-    for (auto &poly_hits : hits)
+    int w = 0;
+    for (int s = 0; s < total; ++s)
     {
-        for (auto &seg_hits : poly_hits)
+        int b = off[s], e = off[s + 1];
+        std::sort(store.hits.begin() + b, store.hits.begin() + e,
+                  [](const Hit &u, const Hit &v)
+                  { return u.t < v.t; });
+        off[s] = w;
+        for (int k = b; k < e; ++k)
         {
-            std::sort(seg_hits.begin(), seg_hits.end(),
-                      [](const Hit &u, const Hit &v)
-                      { return u.t < v.t; });
-            std::vector<Hit> u;
-            u.reserve(seg_hits.size());
-            for (const auto &h : seg_hits)
-            {
-                if (u.empty() || norm(h.p - u.back().p) > EPS_MERGE)
-                    u.push_back(h);
-            }
-            seg_hits.swap(u);
+            const Hit &h = store.hits[k];
+            if (w == off[s] || norm(h.p - store.hits[w - 1].p) > EPS_MERGE)
+                store.hits[w++] = h;
         }
     }
-    return hits;
+    off[total] = w;
+    store.hits.resize(w);
+    return store;
 }
 
-TrenchGraph build_trench_strict(const Roads &roads, double boundary_step)
+TrenchGraph build_trench_strict(const Roads &roads, double boundary_step, std::vector<NodeOrigin> *origin)
 {
     TrenchGraph g;
-
-    std::vector<std::vector<Pt>> sampled;
-    sampled.reserve(roads.polygons.size());
-    std::vector<std::vector<char>> keep;
-    keep.reserve(roads.polygons.size());
-
-    for (int i = 0; i < (int)roads.polygons.size(); ++i)
+    Arena arena;
+    auto *mr = arena.get();
+    // арена растёт по ходу всего построения; её блоки - на метку контейнера, при которой выросла
+    memtrack::Tag tag_samples("ring samples");
+
+    int P = (int)roads.polygons.size();
+    avector<avector<Pt>> sampled(mr);
+    sampled.reserve(P);
+    avector<avector<char>> keep(mr);
+    keep.reserve(P);
+
+    for (int i = 0; i < P; ++i)
     {
-        auto s = sample_ring(roads.polygons[i].ring, boundary_step);
-        sampled.push_back(s);
+        sampled.emplace_back();
+        auto &s = sampled.back();
+        sample_ring_into(roads.polygons[i].ring, boundary_step, s);
 
-        std::vector<char> k(s.size(), 1);
+        keep.emplace_back(s.size(), (char)1);
+        auto &k = keep.back();
         for (int j = 0; j < (int)s.size(); ++j)
         {
-            if (inside_any_other(s[j], roads, i))
+            if (inside_any_other(s[j], roads, i) || roads.obstacles.contains(s[j]))
                 k[j] = 0;
         }
-        keep.push_back(std::move(k));
     }
 
-    auto hits = collect_cross_hits(sampled);
+    memtrack::Tag tag_hits("cross hits");
+    auto hits = collect_cross_hits(sampled, mr);
+
+    memtrack::Tag tag_index("node_index");
+    // узлов не больше, чем точек выборки и пересечений: таблица не перестраивается
+    size_t max_nodes = hits.hits.size();
+    for (const auto &s : sampled)
+        max_nodes += s.size();
+    NodeIndex node_index;
+    node_index.reserve(max_nodes);
 
-    std::unordered_map<long long, int> node_index;
-    node_index.reserve(200000);
+    avector<int> chain_ids(mr);
 
-    for (int selfIdx = 0; selfIdx < (int)roads.polygons.size(); ++selfIdx)
+    for (int selfIdx = 0; selfIdx < P; ++selfIdx)
     {
         const auto &s = sampled[selfIdx];
         const auto &k = keep[selfIdx];
@@ -235,22 +301,29 @@ TrenchGraph build_trench_strict(const Roads &roads, double boundary_step)
             continue;
         int n = (int)s.size();
 
-        auto id_of = [&](Pt p) -> int
-        { return add_node_dedup(g, node_index, p); };
-
         for (int i = 0; i < n; ++i)
         {
             Pt A = s[i], B = s[(i + 1) % n];
 
-            std::vector<int> chain_ids;
-            chain_ids.reserve(4 + hits[selfIdx][i].size());
+            chain_ids.clear();
+            chain_ids.reserve(4 + hits.count(selfIdx, i));
+
+            auto id_of = [&](Pt p) -> int
+            {
+                size_t before = g.nodes.size();
+                int id = add_node_dedup(g, node_index, p);
+                if (origin && g.nodes.size() > before)
+                    origin->push_back({selfIdx, i, (int)chain_ids.size()});
+                return id;
+            };
 
             if (k[i])
                 chain_ids.push_back(id_of(A));
 
-            for (const auto &h : hits[selfIdx][i])
+            for (const Hit *h = hits.begin(selfIdx, i); h != hits.end(selfIdx, i); ++h)
             {
-                chain_ids.push_back(id_of(h.p));
+                if (!roads.obstacles.contains(h->p))
+                    chain_ids.push_back(id_of(h->p));
             }
 
             if (k[(i + 1) % n])
@@ -262,7 +335,7 @@ TrenchGraph build_trench_strict(const Roads &roads, double boundary_step)
                 if (u == v)
                     continue;
                 Seg seg{g.nodes[u], g.nodes[v]};
-                if (!seg_crosses_other_roads(seg, roads, selfIdx))
+                if (!seg_crosses_other_roads(seg, roads, selfIdx) && !roads.obstacles.blocks(seg))
                 {
                     g.edges.emplace_back(u, v);
                 }
@@ -270,5 +343,143 @@ TrenchGraph build_trench_strict(const Roads &roads, double boundary_step)
         }
     }
 
+    memtrack::Tag tag_canon("canonicalize");
+    g.removed_edges = canonicalize_trench_edges(g);
+    return g;
+}
+
+TrenchGraph build_trench_union(const Roads &roads, double boundary_step)
+{
+    TrenchGraph g;
+    Arena arena;
+    NodeIndex node_index;
+
+    avector<Pt> s(arena.get());
+    avector<int> ids(arena.get());
+    for (const auto &ring : union_outline(roads, &g.open_outline_rings))
+    {
+        sample_ring_into(ring, boundary_step, s);
+        int n = (int)s.size();
+        if (n < 2)
+            continue;
+
+        ids.resize(n);
+        for (int i = 0; i < n; ++i)
+            ids[i] = roads.obstacles.contains(s[i]) ? -1 : add_node_dedup(g, node_index, s[i]);
+
+        for (int i = 0; i < n; ++i)
+        {
+            int u = ids[i], v = ids[(i + 1) % n];
+            if (u >= 0 && v >= 0 && u != v && !roads.obstacles.blocks({g.nodes[u], g.nodes[v]}))
+                g.edges.emplace_back(u, v);
+        }
+    }
+    g.removed_edges = canonicalize_trench_edges(g);
     return g;
 }
+
+int canonicalize_trench_edges(TrenchGraph &g, int threads)
+{
+    // узел ближе EPS_ON к внутренности ребра считается лежащим на нём (узлы склеиваются с шагом 1 мм)
+    const double EPS_ON = 1e-3;
+    int E = (int)g.edges.size();
+    if (E == 0)
+        return 0;
+
+    double total = 0.0;
+    for (auto [u, v] : g.edges)
+        total += norm(g.nodes[v] - g.nodes[u]);
+    double cell = std::max(1.0, total / E);
+
+    std::unordered_map<long long, std::vector<int>> grid;
+    auto cell_of = [&](double x)
+    { return (long long)std::floor(x / cell); };
+    for (int i = 0; i < (int)g.nodes.size(); ++i)
+        grid[(cell_of(g.nodes[i].x) << 32) ^ (cell_of(g.nodes[i].y) & 0xffffffff)].push_back(i);
+
+    // смежность исходных рёбер (CSR): ребро режется только в узлах, из которых идёт ребро вдоль него
+    const int V = (int)g.nodes.size();
+    std::vector<int> adj_begin(V + 1, 0), adj(2 * (size_t)E);
+    for (auto [u, v] : g.edges)
+        adj_begin[u + 1]++, adj_begin[v + 1]++;
+    for (int i = 0; i < V; ++i)
+        adj_begin[i + 1] += adj_begin[i];
+    {
+        std::vector<int> pos(adj_begin.begin(), adj_begin.end() - 1);
+        for (auto [u, v] : g.edges)
+            adj[pos[u]++] = v, adj[pos[v]++] = u;
+    }
+
+    // каждое ребро -> цепочка кусков между узлами на нём, упорядоченными по параметру.
+    // Узел на ребре без коллинеарного ребра (Т-образный примыкающий) его не режет.
+    std::vector<std::vector<std::pair<int, int>>> pieces(E);
+    parallel_for(E, [&](int e)
+                 {
+        auto [u, v] = g.edges[e];
+        Pt a = g.nodes[u], b = g.nodes[v], ab = b - a;
+        double L2 = norm2(ab);
+        auto &out = pieces[e];
+        if (u == v || L2 < EPS_ON * EPS_ON)
+        {
+            if (u != v)
+                out.emplace_back(std::min(u, v), std::max(u, v));
+            return;
+        }
+        std::vector<std::pair<double, int>> inner;
+        for (long long cx = cell_of(std::min(a.x, b.x) - EPS_ON); cx <= cell_of(std::max(a.x, b.x) + EPS_ON); ++cx)
+            for (long long cy = cell_of(std::min(a.y, b.y) - EPS_ON); cy <= cell_of(std::max(a.y, b.y) + EPS_ON); ++cy)
+            {
+                auto it = grid.find((cx << 32) ^ (cy & 0xffffffff));
+                if (it == grid.end())
+                    continue;
+                for (int w : it->second)
+                {
+                    if (w == u || w == v)
+                        continue;
+                    double t = dot(g.nodes[w] - a, ab) / L2;
+                    if (t <= 0.0 || t >= 1.0)
+                        continue;
+                    if (dist_point_seg(g.nodes[w], {a, b}) >= EPS_ON)
+                        continue;
+                    const double L = std::sqrt(L2);
+                    bool overlap = false;
+                    for (int k = adj_begin[w]; k < adj_begin[w + 1] && !overlap; ++k)
+                        overlap = std::fabs(cross(ab, g.nodes[adj[k]] - a)) / L < EPS_ON;
+                    if (overlap)
+                        inner.emplace_back(t, w);
+                }
+            }
+        std::sort(inner.begin(), inner.end());
+        int prev = u;
+        for (auto [t, w] : inner)
+        {
+            out.emplace_back(std::min(prev, w), std::max(prev, w));
+            prev = w;
+        }
+        out.emplace_back(std::min(prev, v), std::max(prev, v)); }, threads);
+
+    // куски с номером исходного ребра: исходное ребро убрано, если все его куски - повторы
+    // кусков рёбер с меньшими номерами
+    struct Piece
+    {
+        int a, b, e;
+        bool operator<(const Piece &o) const { return std::tie(a, b, e) < std::tie(o.a, o.b, o.e); }
+    };
+    std::vector<Piece> all;
+    for (int e = 0; e < E; ++e)
+        for (auto [a, b] : pieces[e])
+            all.push_back({a, b, e});
+    parallel_sort(all, threads);
+
+    std::vector<std::pair<int, int>> edges;
+    std::vector<char> kept(E, 0);
+    for (size_t k = 0; k < all.size(); ++k)
+        if (k == 0 || all[k].a != all[k - 1].a || all[k].b != all[k - 1].b)
+        {
+            edges.emplace_back(all[k].a, all[k].b);
+            kept[all[k].e] = 1;
+        }
+
+    g.edges = std::move(edges);
+    return E - (int)std::count(kept.begin(), kept.end(), 1);
+}
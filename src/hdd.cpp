@@ -1,8 +1,11 @@
 #include "hdd.h"
 #include "geometry.h"
+#include "arena.h"
+#include "memtrack.h"
 #include <unordered_map>
 #include <cmath>
 #include <algorithm>
+#include <limits>
 
 using std::pair;
 using std::vector;
@@ -20,7 +23,7 @@ static bool segment_is_cross_across_polygon(const Seg &s, const Roads &roads, in
     const auto &poly = roads.polygons[polyIdx];
     Pt mid{(s.a.x + s.b.x) / 2.0, (s.a.y + s.b.y) / 2.0};
 
-    if (!point_in_polygon(mid, poly.ring))
+    if (!polygon_contains(poly, mid))
         return false; // середина должна быть внутри этой дороги
 
     //  имеется как минимум два пересечения с его границей (вход и выход) - пока отмена ибо не работает
@@ -62,30 +65,76 @@ static double line_angle_deg(const Pt &p1, const Pt &p2, const Pt &a, const Pt &
 
 
 // для каждой точки пересечения угол из [90-alpha, 90+alpha].
-static bool all_intersections_within_perp_band(const Roads &roads, int polyIdx,
-                                               const Seg &s, double alphaDeg)
+// Возвращает наименьший alpha, при котором это выполняется (с тем же допуском 1°),
+// -1 - если пересечений нет, +inf - если условие нарушено для alphaDeg.
+static double perp_band_alpha(const Roads &roads, int polyIdx,
+                              const Seg &s, double alphaDeg)
 {
-    // return true;
-    const auto &R = roads.polygons[polyIdx].ring;
+    // return 0.0;
+    const auto &poly = roads.polygons[polyIdx];
+    const auto &R = poly.ring;
     bool any = false;
+    double need = 0.0;
     const double lo = 90.0 - alphaDeg;
     const double hi = 90.0 + alphaDeg;
 
-    for (size_t k = 1; k < R.size(); ++k)
-    {
+    bool bad = for_each_ring_edge_near(poly, s, [&](int k)
+                                       {
         Pt ip;
-        if (seg_intersect(s, {R[k - 1], R[k]}, &ip))
-        {
-            any = true;
-            double ang = line_angle_deg(s.a, s.b, R[k - 1], R[k]);
-            double ang1 = line_angle_deg(s.b, s.a, R[k - 1], R[k]);
-            if (!(ang + 1 >= lo && ang - 1 <= hi))
-            {
-                return false;
-            }
-        }
+        if (!seg_intersect(s, {R[k - 1], R[k]}, &ip))
+            return false;
+        any = true;
+        double ang = line_angle_deg(s.a, s.b, R[k - 1], R[k]);
+        need = std::max(need, std::fabs(ang - 90.0) - 1.0);
+        return !(ang + 1 >= lo && ang - 1 <= hi); });
+    if (!any)
+        return -1.0;
+    return bad ? std::numeric_limits<double>::infinity() : need;
+}
+
+static const double INF = std::numeric_limits<double>::infinity();
+
+// Ключ ячейки сетки со стороной cell, сдвинутой на (dx, dy) от ячейки точки p
+static long long cell_key(const Pt &p, double cell, long long dx, long long dy)
+{
+    long long ix = (long long)std::floor(p.x / cell) + dx, iy = (long long)std::floor(p.y / cell) + dy;
+    return (ix << 32) ^ (iy & 0xffffffff);
+}
+
+double cross_edge_alpha(const Roads &roads, const Pt &a, const Pt &b, const HDDParams &prm)
+{
+    Pt d = b - a;
+    double L = std::sqrt(d.x * d.x + d.y * d.y);
+    if (L + 1e-9 < prm.cross_min || L - 1e-9 > prm.cross_max)
+        return INF;
+
+    Seg s{a, b};
+
+    // Должен пересекать ВНУТРЕННОСТЬ хотя бы одной дороги и удовлетворять углу 90°±α
+    double need = INF;
+    for (int pi = 0; pi < (int)roads.polygons.size(); ++pi)
+    {
+        if (!segment_is_cross_across_polygon(s, roads, pi))
+            continue;
+        double al = perp_band_alpha(roads, pi, s, prm.cross_angle_tol_deg);
+        if (al < 0.0 || al == INF)
+            continue;
+        need = std::min(need, al);
+        if (!prm.min_alpha_over_roads)
+            break;
     }
-    return any;
+    if (need != INF && roads.obstacles.blocks(s))
+        return INF;
+    return need;
+}
+
+HDDParams make_hdd_params(const Config &cfg)
+{
+    HDDParams prm;
+    prm.cross_min = cfg.hdd_min_length;
+    prm.cross_max = cfg.hdd_max_length;
+    prm.cross_angle_tol_deg = cfg.hdd_alpha_deg;
+    return prm;
 }
 
 HDDGraph build_hdd_from_trench(const Roads &roads,
@@ -94,7 +143,7 @@ HDDGraph build_hdd_from_trench(const Roads &roads,
                                const HDDParams &prm)
 {
     HDDGraph g;
-
+    memtrack::Tag tag_copy("hdd copy");
 
     g.nodes = trench_nodes;
     g.trench_to_hdd.resize(trench_nodes.size());
@@ -103,66 +152,136 @@ HDDGraph build_hdd_from_trench(const Roads &roads,
 
 
     g.edges = trench_edges;
+    g.trench_edge_count = (int)trench_edges.size();
+    g.edge_alpha.assign(trench_edges.size(), 0.0);
 
     // Рёбра поперёк дорог — добавляем все пары (i,j), удовлетворяющие длине и углу
+    memtrack::Tag tag_grid("hdd grid");
+    Arena arena;
+    auto *mr = arena.get();
+
+    // сетка в CSR: пары (ячейка, узел) сортируются, ячейки ищутся двоичным поиском.
+    // Все массивы выделяются в арене один раз нужного размера - в монотонной арене
+    // перестройки растущих контейнеров оставляли бы старые буферы до конца построения.
+    const int N = (int)g.nodes.size();
     double cell = std::max(1e-6, prm.cross_max);
-    std::unordered_map<long long, vector<int>> grid;
-    auto cellKey = [&](const Pt &p)
+    avector<std::pair<long long, int>> by_cell(N, mr);
+    for (int i = 0; i < N; ++i)
+        by_cell[i] = {cell_key(g.nodes[i], cell, 0, 0), i};
+    std::sort(by_cell.begin(), by_cell.end()); // внутри ячейки - по возрастанию номера, как при вставке
+    avector<long long> cells(mr);
+    avector<int> cell_begin(mr);
+    avector<int> cell_nodes(N, 0, mr);
+    size_t n_cells = 0;
+    for (int k = 0; k < N; ++k)
+        n_cells += k == 0 || by_cell[k].first != by_cell[k - 1].first;
+    cells.reserve(n_cells);
+    cell_begin.reserve(n_cells + 1);
+    for (int k = 0; k < N; ++k)
     {
-        long long ix = (long long)std::floor(p.x / cell), iy = (long long)std::floor(p.y / cell);
-        return (ix << 32) ^ (iy & 0xffffffff);
-    };
-    for (int i = 0; i < (int)g.nodes.size(); ++i)
-        grid[cellKey(g.nodes[i])].push_back(i);
+        if (k == 0 || by_cell[k].first != by_cell[k - 1].first)
+        {
+            cells.push_back(by_cell[k].first);
+            cell_begin.push_back(k);
+        }
+        cell_nodes[k] = by_cell[k].second;
+    }
+    cell_begin.push_back(N);
 
-    auto nearby = [&](const Pt &p)
+    std::vector<int> cand; // растёт по ходу - в куче
+    cand.reserve(256);
+    auto nearby = [&](const Pt &p, std::vector<int> &out)
     {
-        vector<int> out;
-        out.reserve(64);
-        long long ix = (long long)std::floor(p.x / cell), iy = (long long)std::floor(p.y / cell);
+        out.clear();
         for (long long dx = -1; dx <= 1; ++dx)
             for (long long dy = -1; dy <= 1; ++dy)
             {
-                auto it = grid.find(((ix + dx) << 32) ^ ((iy + dy) & 0xffffffff));
-                if (it != grid.end())
-                    out.insert(out.end(), it->second.begin(), it->second.end());
+                long long key = cell_key(p, cell, dx, dy);
+                auto it = std::lower_bound(cells.begin(), cells.end(), key);
+                if (it == cells.end() || *it != key)
+                    continue;
+                size_t c = it - cells.begin();
+                out.insert(out.end(), cell_nodes.begin() + cell_begin[c], cell_nodes.begin() + cell_begin[c + 1]);
             }
-        return out;
     };
 
-    auto L2 = [](const Pt &a, const Pt &b)
-    { Pt d=b-a; return d.x*d.x + d.y*d.y; };
-
-    for (int i = 0; i < (int)g.nodes.size(); ++i)
+    memtrack::Tag tag_cross("hdd cross edges");
+    for (int i = 0; i < N; ++i)
     {
-        auto cand = nearby(g.nodes[i]);
+        nearby(g.nodes[i], cand);
         for (int j : cand)
         {
             if (j <= i)
                 continue; // избежать дублей и петель
 
-            double L = std::sqrt(L2(g.nodes[i], g.nodes[j]));
-            if (L + 1e-9 < prm.cross_min || L - 1e-9 > prm.cross_max)
-                continue;
-
-            Seg s{g.nodes[i], g.nodes[j]};
-
-            // Должен пересекать ВНУТРЕННОСТЬ хотя бы одной дороги и удовлетворять углу 90°±α
-            bool ok = false;
-            for (int pi = 0; pi < (int)roads.polygons.size(); ++pi)
-            {
-                if (segment_is_cross_across_polygon(s, roads, pi) && all_intersections_within_perp_band(roads, pi, s, prm.cross_angle_tol_deg))
-                {
-                    ok = true;
-                    break;
-                }
-            }
-            if (!ok)
+            double need = cross_edge_alpha(roads, g.nodes[i], g.nodes[j], prm);
+            if (need == INF)
                 continue;
 
             g.edges.emplace_back(i, j);
+            g.edge_alpha.push_back(need);
         }
     }
 
     return g;
 }
+
+HDDGraph filter_hdd(const HDDGraph &loose, const HDDParams &prm)
+{
+    HDDGraph g;
+    g.nodes = loose.nodes;
+    g.trench_to_hdd = loose.trench_to_hdd;
+    g.trench_edge_count = loose.trench_edge_count;
+    g.edges.assign(loose.edges.begin(), loose.edges.begin() + loose.trench_edge_count);
+    g.edge_alpha.assign(loose.trench_edge_count, 0.0);
+
+    for (size_t e = loose.trench_edge_count; e < loose.edges.size(); ++e)
+    {
+        auto [i, j] = loose.edges[e];
+        Pt d = g.nodes[j] - g.nodes[i];
+        double L = std::sqrt(d.x * d.x + d.y * d.y);
+        if (L + 1e-9 < prm.cross_min || L - 1e-9 > prm.cross_max)
+            continue;
+        if (loose.edge_alpha[e] > prm.cross_angle_tol_deg)
+            continue;
+        g.edges.push_back(loose.edges[e]);
+        g.edge_alpha.push_back(loose.edge_alpha[e]);
+    }
+    return g;
+}
+
+LazyHDD::LazyHDD(const Roads &roads, const vector<Pt> &nodes, const HDDParams &prm)
+    : roads_(roads), nodes_(nodes), prm_(prm), cell_(std::max(1e-6, prm.cross_max))
+{
+    for (int i = 0; i < (int)nodes_.size(); ++i)
+        grid_[cell_key(nodes_[i], cell_, 0, 0)].push_back(i);
+}
+
+const vector<int> &LazyHDD::cross_neighbours(int i)
+{
+    auto it = memo_.find(i);
+    if (it != memo_.end())
+        return it->second;
+
+    vector<int> out;
+    const Pt &p = nodes_[i];
+    for (long long dx = -1; dx <= 1; ++dx)
+        for (long long dy = -1; dy <= 1; ++dy)
+        {
+            auto c = grid_.find(cell_key(p, cell_, dx, dy));
+            if (c == grid_.end())
+                continue;
+            for (int j : c->second)
+            {
+                if (j == i)
+                    continue;
+                // отрезок в том же направлении (от меньшего номера), что и в build_hdd_from_trench
+                int a = std::min(i, j), b = std::max(i, j);
+                if (cross_edge_alpha(roads_, nodes_[a], nodes_[b], prm_) != INF)
+                    out.push_back(j);
+            }
+        }
+    tested_ += 1;
+    found_ += out.size();
+    return memo_.emplace(i, std::move(out)).first->second;
+}
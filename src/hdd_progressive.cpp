@@ -0,0 +1,330 @@
+#include "hdd_progressive.h"
+#include "reorder.h"
+#include "parallel.h"
+#include "stage_cache.h"
+#include "geojson_writer.h"
+#include "memtrack.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <filesystem>
+#include <limits>
+#include <unordered_map>
+
+namespace
+{
+    const uint32_t CKPT_MAGIC = 0x50444848; // "HHDP"
+    const uint32_t CKPT_VERSION = 1;
+    const uint32_t CHUNK_BEGIN = 0x4b4e4843; // "CHNK"
+    const uint32_t CHUNK_END = 0x43484e4b;
+
+    // Поперечное ребро из списка узла i куска: j > i - обычное (как в build_hdd_from_trench),
+    // j < i - только к узлу более позднего куска (нужно, если тот так и не будет построен)
+    struct Entry
+    {
+        int i, j;
+        double alpha;
+    };
+
+    // Всё, от чего зависят рёбра: узлы, параметры, дороги и препятствия, размер куска
+    uint64_t input_hash(const Roads &roads, const std::vector<Pt> &nodes, const HDDParams &prm, int chunk_nodes)
+    {
+        uint64_t h = StageCache::hash(nodes.data(), nodes.size() * sizeof(Pt));
+        h = StageCache::hash(prm.cross_min, h);
+        h = StageCache::hash(prm.cross_max, h);
+        h = StageCache::hash(prm.cross_angle_tol_deg, h);
+        h = StageCache::hash(prm.min_alpha_over_roads ? 1.0 : 0.0, h);
+        h = StageCache::hash((double)chunk_nodes, h);
+        for (const auto &poly : roads.polygons)
+            h = StageCache::hash(poly.ring.data(), poly.ring.size() * sizeof(Pt), h);
+        for (const auto &poly : roads.obstacles.polygons)
+            h = StageCache::hash(poly.ring.data(), poly.ring.size() * sizeof(Pt), h);
+        for (const auto &line : roads.obstacles.lines)
+            h = StageCache::hash(line.data(), line.size() * sizeof(Pt), h);
+        return h;
+    }
+
+    struct Header
+    {
+        uint32_t magic, version;
+        uint64_t hash;
+        int32_t nodes, chunks;
+    };
+
+    enum class Checkpoint
+    {
+        missing,   // файла нет
+        discarded, // файл от других входных данных или не контрольная точка
+        resumed,
+    };
+
+    // Готовые куски из контрольной точки; файл обрезается после последнего целого куска.
+    // Запись с длиной больше оставшихся байт файла или больше bound[c] (сумма кандидатов узлов
+    // куска) считается оборванным хвостом, как и запись без конечной метки.
+    Checkpoint read_checkpoint(const std::string &path, const Header &want, const std::vector<uint64_t> &bound,
+                               std::vector<std::vector<Entry>> &chunk_entries, std::vector<char> &done)
+    {
+        std::error_code ec;
+        const uint64_t size = std::filesystem::file_size(path, ec);
+        if (ec)
+            return Checkpoint::missing;
+        FILE *f = fopen(path.c_str(), "rb");
+        if (!f)
+            return Checkpoint::missing;
+        Header h{};
+        bool ok = fread(&h, sizeof(h), 1, f) == 1 && h.magic == want.magic && h.version == want.version &&
+                  h.hash == want.hash && h.nodes == want.nodes && h.chunks == want.chunks;
+        uint64_t good = sizeof(Header);
+        const uint64_t record = 4 + 4 + 8 + 4; // метки, номер куска и длина
+        while (ok)
+        {
+            uint32_t begin = 0, end = 0;
+            int32_t c = -1;
+            uint64_t n = 0;
+            if (fread(&begin, 4, 1, f) != 1 || begin != CHUNK_BEGIN || fread(&c, 4, 1, f) != 1 ||
+                fread(&n, 8, 1, f) != 1 || c < 0 || c >= want.chunks || n > bound[c] ||
+                good + record + n * sizeof(Entry) > size)
+                break;
+            std::vector<Entry> e(n);
+            if (fread(e.data(), sizeof(Entry), n, f) != n || fread(&end, 4, 1, f) != 1 || end != CHUNK_END)
+                break;
+            chunk_entries[c] = std::move(e);
+            done[c] = 1;
+            good += record + n * sizeof(Entry);
+        }
+        fclose(f);
+        if (!ok)
+            return Checkpoint::discarded;
+        std::filesystem::resize_file(path, good, ec);
+        return Checkpoint::resumed;
+    }
+
+    void append_chunk(FILE *f, int c, const std::vector<Entry> &e)
+    {
+        int32_t c32 = c;
+        uint64_t n = e.size();
+        fwrite(&CHUNK_BEGIN, 4, 1, f);
+        fwrite(&c32, 4, 1, f);
+        fwrite(&n, 8, 1, f);
+        fwrite(e.data(), sizeof(Entry), e.size(), f);
+        fwrite(&CHUNK_END, 4, 1, f);
+        fflush(f);
+    }
+}
+
+int HDDCoverage::done() const
+{
+    int n = 0;
+    for (const auto &c : chunks)
+        n += c.done;
+    return n;
+}
+
+HDDGraph build_hdd_progressive(const Roads &roads, const std::vector<Pt> &trench_nodes,
+                               const std::vector<std::pair<int, int>> &trench_edges, const HDDParams &prm,
+                               const ProgressiveHDD &opt, HDDCoverage *coverage)
+{
+    using clock = std::chrono::steady_clock;
+    const auto t0 = clock::now();
+    auto elapsed = [&]
+    { return std::chrono::duration<double>(clock::now() - t0).count(); };
+
+    const int N = (int)trench_nodes.size();
+    const int chunk = std::max(1, opt.chunk_nodes);
+    std::vector<int> order = hilbert_order(trench_nodes);
+    const int C = (N + chunk - 1) / chunk;
+    std::vector<int> chunk_of(N);
+    for (int k = 0; k < N; ++k)
+        chunk_of[order[k]] = k / chunk;
+
+    // та же сетка и тот же порядок кандидатов, что в build_hdd_from_trench
+    const double cell = std::max(1e-6, prm.cross_max);
+    auto key = [&](const Pt &p, long long dx, long long dy)
+    {
+        long long ix = (long long)std::floor(p.x / cell) + dx, iy = (long long)std::floor(p.y / cell) + dy;
+        return (ix << 32) ^ (iy & 0xffffffff);
+    };
+    std::unordered_map<long long, std::vector<int>> grid;
+    for (int i = 0; i < N; ++i)
+        grid[key(trench_nodes[i], 0, 0)].push_back(i);
+
+    // наибольшее число записей куска: все пары узла с соседями по сетке
+    std::vector<uint64_t> bound(C, 0);
+    for (int k = 0; k < N; ++k)
+    {
+        const Pt &p = trench_nodes[order[k]];
+        for (long long dx = -1; dx <= 1; ++dx)
+            for (long long dy = -1; dy <= 1; ++dy)
+            {
+                auto it = grid.find(key(p, dx, dy));
+                if (it != grid.end())
+                    bound[k / chunk] += it->second.size();
+            }
+    }
+
+    memtrack::Tag tag_cross("hdd cross edges");
+    std::vector<std::vector<Entry>> chunk_entries(C);
+    std::vector<char> done(C, 0), resumed(C, 0);
+
+    Header head{CKPT_MAGIC, CKPT_VERSION, input_hash(roads, trench_nodes, prm, chunk), N, C};
+    FILE *ckpt = nullptr;
+    if (!opt.checkpoint.empty())
+    {
+        Checkpoint state = read_checkpoint(opt.checkpoint, head, bound, chunk_entries, done);
+        const bool resume = state == Checkpoint::resumed;
+        resumed = done;
+        if (opt.log && state == Checkpoint::discarded)
+            *opt.log << "HDD progress: checkpoint " << opt.checkpoint
+                     << " is from other input data or damaged, discarded and started anew\n";
+        ckpt = fopen(opt.checkpoint.c_str(), resume ? "ab" : "wb");
+        if (ckpt && !resume)
+            fwrite(&head, sizeof(head), 1, ckpt);
+        if (opt.log && resume)
+            *opt.log << "HDD progress: resumed " << std::count(done.begin(), done.end(), 1) << "/" << C
+                     << " chunks from " << opt.checkpoint << "\n";
+    }
+
+    size_t cross_edges = 0;
+    for (const auto &e : chunk_entries)
+        cross_edges += e.size();
+    int processed_now = 0; // узлов в этом запуске - для скорости и оценки
+    int remaining = 0;
+    for (int c = 0; c < C; ++c)
+        if (!done[c])
+            remaining += std::min(N, (c + 1) * chunk) - c * chunk;
+
+    bool stopped = false;
+    for (int c = 0; c < C; ++c)
+    {
+        if (done[c])
+            continue;
+        if (opt.time_budget_s > 0.0 && elapsed() >= opt.time_budget_s)
+        {
+            stopped = true;
+            break;
+        }
+        const int lo = c * chunk, hi = std::min(N, lo + chunk);
+        std::vector<std::vector<Entry>> per(hi - lo);
+        parallel_for(hi - lo, [&](int k)
+                     {
+            const int i = order[lo + k];
+            const Pt &p = trench_nodes[i];
+            for (long long dx = -1; dx <= 1; ++dx)
+                for (long long dy = -1; dy <= 1; ++dy)
+                {
+                    auto it = grid.find(key(p, dx, dy));
+                    if (it == grid.end())
+                        continue;
+                    for (int j : it->second)
+                    {
+                        if (j == i || (j < i && chunk_of[j] <= c))
+                            continue;
+                        int a = std::min(i, j), b = std::max(i, j);
+                        double al = cross_edge_alpha(roads, trench_nodes[a], trench_nodes[b], prm);
+                        if (al != std::numeric_limits<double>::infinity())
+                            per[k].push_back({i, j, al});
+                    }
+                } }, opt.threads);
+
+        auto &entries = chunk_entries[c];
+        for (auto &v : per)
+            entries.insert(entries.end(), v.begin(), v.end());
+        done[c] = 1;
+        if (ckpt)
+            append_chunk(ckpt, c, entries);
+
+        cross_edges += entries.size();
+        processed_now += hi - lo;
+        remaining -= hi - lo;
+        if (opt.log)
+        {
+            double t = elapsed(), rate = t > 0 ? processed_now / t : 0.0;
+            char line[200];
+            std::snprintf(line, sizeof(line),
+                          "HDD progress: chunk %d/%d, nodes %d/%d (%.1f%%), entries %zu, %.0f nodes/s, ETA %.0f s\n",
+                          (int)std::count(done.begin(), done.end(), 1), C, N - remaining, N,
+                          N ? 100.0 * (N - remaining) / N : 100.0, cross_edges, rate,
+                          rate > 0 ? remaining / rate : 0.0);
+            *opt.log << line;
+        }
+    }
+    if (ckpt)
+        fclose(ckpt);
+    if (opt.log && stopped)
+        *opt.log << "HDD progress: time budget " << opt.time_budget_s << " s exhausted, " << remaining
+                 << " nodes left for the next run\n";
+
+    // сборка: рёбра узлов готовых кусков (j > i) по возрастанию i, как в build_hdd_from_trench,
+    // плюс рёбра от недостроенных узлов к готовым
+    std::vector<std::vector<std::pair<int, double>>> own(N), extra(N);
+    for (int c = 0; c < C; ++c)
+        if (done[c])
+            for (const Entry &e : chunk_entries[c])
+            {
+                if (e.j > e.i)
+                    own[e.i].push_back({e.j, e.alpha});
+                else if (!done[chunk_of[e.j]])
+                    extra[e.j].push_back({e.i, e.alpha});
+            }
+
+    HDDGraph g;
+    g.nodes = trench_nodes;
+    g.trench_to_hdd.resize(N);
+    for (int i = 0; i < N; ++i)
+        g.trench_to_hdd[i] = i;
+    g.edges = trench_edges;
+    g.trench_edge_count = (int)trench_edges.size();
+    g.edge_alpha.assign(trench_edges.size(), 0.0);
+    for (int u = 0; u < N; ++u)
+    {
+        auto &list = done[chunk_of[u]] ? own[u] : extra[u];
+        if (!done[chunk_of[u]])
+            std::sort(list.begin(), list.end());
+        for (auto [v, al] : list)
+        {
+            g.edges.emplace_back(u, v);
+            g.edge_alpha.push_back(al);
+        }
+    }
+
+    if (coverage)
+    {
+        coverage->chunks.assign(C, {});
+        for (int c = 0; c < C; ++c)
+        {
+            auto &ch = coverage->chunks[c];
+            ch.x0 = ch.y0 = INFINITY;
+            ch.x1 = ch.y1 = -INFINITY;
+            for (int k = c * chunk; k < std::min(N, (c + 1) * chunk); ++k)
+            {
+                const Pt &p = trench_nodes[order[k]];
+                ch.x0 = std::min(ch.x0, p.x);
+                ch.y0 = std::min(ch.y0, p.y);
+                ch.x1 = std::max(ch.x1, p.x);
+                ch.y1 = std::max(ch.y1, p.y);
+                ch.nodes++;
+            }
+            ch.done = done[c];
+            ch.resumed = resumed[c];
+        }
+        coverage->complete = !stopped;
+        coverage->seconds = elapsed();
+    }
+    return g;
+}
+
+void write_hdd_coverage(const std::string &base, const HDDCoverage &coverage)
+{
+    gj::StreamWriter w(base + "_hdd_coverage.geojson", "hdd_coverage");
+    for (size_t c = 0; c < coverage.chunks.size(); ++c)
+    {
+        const auto &ch = coverage.chunks[c];
+        w.add_line({{ch.x0, ch.y0}, {ch.x1, ch.y0}, {ch.x1, ch.y1}, {ch.x0, ch.y1}, {ch.x0, ch.y0}},
+                   {{"chunk", std::to_string(c)},
+                    {"nodes", std::to_string(ch.nodes)},
+                    {"status", ch.resumed ? "resumed" : ch.done ? "done"
+                                                                : "pending"}});
+    }
+    w.finish();
+}
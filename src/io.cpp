@@ -21,7 +21,7 @@ namespace io
     }
 
     // CONFIG
-    static bool extract_double(const string &s, const string &key, double &dst)
+    bool extract_double(const string &s, const string &key, double &dst)
     {
         regex re("\\\"" + key + "\\\"\\s*:\\s*([-+]?([0-9]*\\.)?[0-9]+([eE][-+]?[0-9]+)?)");
         smatch m;
@@ -32,7 +32,7 @@ namespace io
         }
         return false;
     }
-    static bool extract_string(const string &s, const string &key, string &dst)
+    bool extract_string(const string &s, const string &key, string &dst)
     {
         regex re("\\\"" + key + "\\\"\\s*:\\s*\\\"([^\\\"]*)\\\"");
         smatch m;
@@ -44,12 +44,31 @@ namespace io
         return false;
     }
 
+    bool extract_numbers(const string &s, const string &key, vector<double> &dst)
+    {
+        regex re("\\\"" + key + "\\\"\\s*:\\s*\\[([^\\]]*)\\]");
+        smatch m;
+        if (!regex_search(s, m, re))
+            return false;
+        dst.clear();
+        string body = m[1].str();
+        regex num("[-+]?([0-9]*\\.)?[0-9]+([eE][-+]?[0-9]+)?");
+        for (auto it = sregex_iterator(body.begin(), body.end(), num); it != sregex_iterator(); ++it)
+            dst.push_back(stod(it->str()));
+        return true;
+    }
+
     bool load_config(const string &path, Config &cfg)
     {
         string s = read_file(path);
         if (s.empty())
             return false;
+        parse_config_text(s, cfg);
+        return true;
+    }
 
+    void parse_config_text(const string &s, Config &cfg)
+    {
         extract_double(s, "trench_per_m", cfg.trench_per_m);
         extract_double(s, "hdd_per_m", cfg.hdd_per_m);
         extract_double(s, "transition_per_edge", cfg.transition_per_edge);
@@ -57,12 +76,27 @@ namespace io
         extract_double(s, "min_length", cfg.hdd_min_length);
         extract_double(s, "max_length", cfg.hdd_max_length);
         extract_double(s, "alpha_deg", cfg.hdd_alpha_deg);
+        extract_string(s, "hdd_mode", cfg.hdd_mode);
 
         extract_double(s, "grid_step", cfg.grid_step);
         extract_double(s, "boundary_sample_step", cfg.boundary_step);
+        extract_string(s, "trench_mode", cfg.trench_mode);
+        extract_string(s, "node_order", cfg.node_order);
+        extract_double(s, "simplify_tolerance", cfg.simplify_tolerance);
+        extract_double(s, "mask_cell", cfg.mask_cell);
+
+        double n = 0.0;
+        if (extract_double(s, "prune_min_nodes", n))
+            cfg.prune_min_nodes = (int)n;
+        extract_double(s, "prune_min_length", cfg.prune_min_length);
 
         extract_string(s, "basename", cfg.output_basename);
-        return true;
+        extract_string(s, "format", cfg.output_format);
+        double z = 0.0;
+        if (extract_double(s, "min_zoom", z))
+            cfg.tile_min_zoom = (int)z;
+        if (extract_double(s, "max_zoom", z))
+            cfg.tile_max_zoom = (int)z;
     }
 
     //  GEOJSON
@@ -151,7 +185,7 @@ namespace io
                 break;
             auto ring = parse_coords_array(s, coords);
             if (!ring.empty())
-                roads.polygons.push_back({ring});
+                roads.polygons.push_back({ring, {}, {}});
             pos += 8;
         }
     }
@@ -192,7 +226,7 @@ namespace io
             {
                 auto ring = parse_coords_array(s, firstRingPos);
                 if (!ring.empty())
-                    roads.polygons.push_back({ring});
+                    roads.polygons.push_back({ring, {}, {}});
             }
             pos += 12;
         }
@@ -242,14 +276,14 @@ namespace io
                         num.clear();
                     }
                     depth--;
-                    if (depth == 1)
+                    if (depth == 0)
                     {
                         break;
                     }
                     else
                         continue;
                 }
-                if ((c == '-' || c == '+' || isdigit((unsigned char)c) || c == '.' || c == 'e' || c == 'E') && depth >= 3)
+                if ((c == '-' || c == '+' || isdigit((unsigned char)c) || c == '.' || c == 'e' || c == 'E') && depth >= 2)
                 {
                     inNum = true;
                     num.push_back(c);
@@ -279,7 +313,11 @@ namespace io
 
     bool load_roads_geojson(const string &path, Roads &roads)
     {
-        string s = read_file(path);
+        return parse_roads_geojson(read_file(path), roads);
+    }
+
+    bool parse_roads_geojson(const string &s, Roads &roads)
+    {
         if (s.empty())
             return false;
         parse_polygons(s, roads);
@@ -288,4 +326,88 @@ namespace io
         return !(roads.polygons.empty() && roads.lines.empty());
     }
 
+    bool load_obstacles_geojson(const string &path, Obstacles &obstacles)
+    {
+        Roads layer;
+        if (!parse_roads_geojson(read_file(path), layer))
+            return false;
+        for (auto &poly : layer.polygons)
+            obstacles.polygons.push_back({std::move(poly.ring), {}, {}});
+        for (auto &line : layer.lines)
+            obstacles.lines.push_back(std::move(line));
+        return true;
+    }
+
+    bool for_each_feature(const string &path, const std::function<void(const string &)> &f)
+    {
+        FILE *in = fopen(path.c_str(), "rb");
+        if (!in)
+            return false;
+
+        // вложенность скобок вне строк; массив фич - "[" после ключа "features" на верхнем уровне
+        vector<char> stack;
+        int features_depth = -1;
+        bool in_str = false, esc = false;
+        string last_str, cur_str, feature;
+        bool capturing = false;
+
+        vector<char> buf(1 << 20);
+        size_t n;
+        while ((n = fread(buf.data(), 1, buf.size(), in)) > 0)
+        {
+            for (size_t k = 0; k < n; ++k)
+            {
+                char c = buf[k];
+                if (capturing)
+                    feature.push_back(c);
+                if (in_str)
+                {
+                    if (esc)
+                        esc = false;
+                    else if (c == '\\')
+                        esc = true;
+                    else if (c == '"')
+                    {
+                        in_str = false;
+                        last_str.swap(cur_str);
+                    }
+                    else if (!capturing)
+                        cur_str.push_back(c);
+                    continue;
+                }
+                if (c == '"')
+                {
+                    in_str = true;
+                    cur_str.clear();
+                }
+                else if (c == '{' || c == '[')
+                {
+                    if (c == '[' && features_depth < 0 && stack.size() == 1 && last_str == "features")
+                        features_depth = (int)stack.size() + 1;
+                    else if (c == '{' && (int)stack.size() == features_depth && !capturing)
+                    {
+                        capturing = true;
+                        feature.assign(1, c);
+                    }
+                    stack.push_back(c);
+                }
+                else if (c == '}' || c == ']')
+                {
+                    if (!stack.empty())
+                        stack.pop_back();
+                    if (capturing && (int)stack.size() == features_depth)
+                    {
+                        capturing = false;
+                        f(feature);
+                        feature.clear();
+                    }
+                    else if (c == ']' && (int)stack.size() + 1 == features_depth)
+                        features_depth = -2; // массив фич закончился
+                }
+            }
+        }
+        fclose(in);
+        return true;
+    }
+
 }
@@ -1,4 +1,7 @@
+#include <atomic>
+#include <cstdio>
 #include <iostream>
+#include <mutex>
 #include <fstream>
 #include <string>
 #include <vector>
@@ -6,13 +9,76 @@
 #include "io.h"
 #include "graph.h"
 #include "hdd.h"
-#include "geojson_writer.h"
+#include "hdd_progressive.h"
+#include "export.h"
 #include "geometry.h"
+#include "session.h"
+#include "server.h"
+#include "batch.h"
+#include "tiles.h"
+#include "ooc.h"
+#include "pipeline.h"
+#include "components.h"
+#include "snap.h"
+#include "memtrack.h"
+#include <chrono>
 
-static void save_text(const std::string &path, const std::string &data)
+// ГНБ по частям (--hdd-budget, --hdd-checkpoint, --hdd-chunk): прогресс - в stderr, контуры кусков -
+// в <out>_hdd_coverage.geojson. Частичный граф в кэш стадий не попадает. Возвращает строки для отчёта.
+static std::string progressive_hdd_stage(Session &session, const Config &cfg, const ProgressiveHDD &opt,
+                                         const std::string &out_base, HDDGraph &out)
 {
-    std::ofstream f(path);
-    f << data;
+    const auto &t = session.trench(cfg);
+    HDDCoverage cov;
+    out = build_hdd_progressive(session.roads, t.nodes, t.edges, make_hdd_params(cfg), opt, &cov);
+    write_hdd_coverage(out_base, cov);
+    char secs[32];
+    std::snprintf(secs, sizeof(secs), "%.1f", cov.seconds);
+    return "HDD: nodes=" + std::to_string(out.nodes.size()) + ", edges=" + std::to_string(out.edges.size()) +
+           " (progressive: " + std::to_string(cov.done()) + "/" + std::to_string(cov.chunks.size()) + " chunks, " +
+           (cov.complete ? "complete" : "partial") + ", " + secs + " s)\nWritten: " + out_base +
+           "_hdd_coverage.geojson";
+}
+
+// Компоненты связности графа ГНБ (в нём и рёбра траншей). pruned_* (если заданы) получают
+// копии графов без компонент меньше порогов prune_*. Возвращает строки для отчёта.
+static std::string components_stage(const Config &cfg, const TrenchGraph &trench, const HDDGraph &hdd,
+                                    TrenchGraph *pruned_trench, HDDGraph *pruned_hdd, int threads)
+{
+    Components c = connected_components(hdd.nodes, hdd.edges, threads);
+    std::string msg = "Components: " + components_summary(c);
+    if (pruned_trench && pruned_hdd)
+    {
+        memtrack::Tag tag("pruned copy");
+        *pruned_trench = trench;
+        *pruned_hdd = hdd;
+        int k = prune_components(*pruned_trench, *pruned_hdd, c, cfg.prune_min_nodes, cfg.prune_min_length);
+        msg += "\nPruned: " + std::to_string(k) + " components, nodes " + std::to_string(hdd.nodes.size()) +
+               " -> " + std::to_string(pruned_hdd->nodes.size()) + ", HDD edges " + std::to_string(hdd.edges.size()) +
+               " -> " + std::to_string(pruned_hdd->edges.size());
+    }
+    return msg;
+}
+
+// Строка о перенумерации узлов траншей (пусто, если её не было или траншеи из кэша)
+static std::string node_order_line(const Config &cfg, const NodeOrderStats &st)
+{
+    if (!st.nodes)
+        return {};
+    char buf[160];
+    std::snprintf(buf, sizeof(buf), "Node order: %s, mean edge span %.1f -> %.1f", cfg.node_order.c_str(),
+                  st.span_before, st.span_after);
+    return buf;
+}
+
+// Строка "Trench: ..." отчёта
+static std::string trench_line(const TrenchGraph &t, bool cached)
+{
+    std::string s = "Trench: nodes=" + std::to_string(t.nodes.size()) + ", edges=" + std::to_string(t.edges.size()) +
+                    " (removed duplicates/overlaps: " + std::to_string(t.removed_edges) + ")";
+    if (t.open_outline_rings)
+        s += ", union outline: " + std::to_string(t.open_outline_rings) + " open rings dropped";
+    return s + (cached ? " (from cache)" : "");
 }
 
 int main(int argc, char **argv)
@@ -20,6 +86,19 @@ int main(int argc, char **argv)
     std::string roads_path;
     std::string config_path;
     std::string out_base = "graph";
+    bool serve = false;
+    std::string socket_path;
+    std::string batch_path;
+    std::string cache_dir;
+    std::string format;
+    int threads = 0;
+    double mem_budget_mb = 0.0;
+    std::string snap_path;
+    SnapParams snap;
+    bool snap_check_roads = false;
+    std::vector<std::string> obstacle_paths;
+    ProgressiveHDD progressive;
+    bool progressive_on = false;
 
     // аргументы
     for (int i = 1; i < argc; i++)
@@ -31,21 +110,60 @@ int main(int argc, char **argv)
             config_path = argv[++i];
         else if (a == "--out" && i + 1 < argc)
             out_base = argv[++i];
+        else if (a == "--serve")
+            serve = true;
+        else if (a == "--socket" && i + 1 < argc)
+            socket_path = argv[++i];
+        else if (a == "--batch" && i + 1 < argc)
+            batch_path = argv[++i];
+        else if (a == "--cache" && i + 1 < argc)
+            cache_dir = argv[++i];
+        else if (a == "--format" && i + 1 < argc)
+            format = argv[++i];
+        else if (a == "--threads" && i + 1 < argc)
+            threads = std::stoi(argv[++i]);
+        else if (a == "--mem-budget" && i + 1 < argc)
+            mem_budget_mb = std::stod(argv[++i]);
+        else if (a == "--snap" && i + 1 < argc)
+            snap_path = argv[++i];
+        else if (a == "--snap-k" && i + 1 < argc)
+            snap.k = std::stoi(argv[++i]);
+        else if (a == "--snap-radius" && i + 1 < argc)
+            snap.radius = std::stod(argv[++i]);
+        else if (a == "--snap-check-roads")
+            snap_check_roads = true;
+        else if (a == "--obstacles" && i + 1 < argc)
+            obstacle_paths.push_back(argv[++i]);
+        else if (a == "--hdd-budget" && i + 1 < argc)
+        {
+            progressive.time_budget_s = std::stod(argv[++i]);
+            progressive_on = true;
+        }
+        else if (a == "--hdd-checkpoint" && i + 1 < argc)
+        {
+            progressive.checkpoint = argv[++i];
+            progressive_on = true;
+        }
+        else if (a == "--hdd-chunk" && i + 1 < argc)
+        {
+            progressive.chunk_nodes = std::stoi(argv[++i]);
+            progressive_on = true;
+        }
     }
+    progressive.log = &std::cerr;
+    progressive.threads = threads;
 
     if (roads_path.empty())
     {
-        std::cerr << "Usage: reader --roads roads.geojson [--config config.json] [--out graph]\n";
+        std::cerr << "Usage: reader --roads roads.geojson [--config config.json] [--out graph] [--format geojson|fgb|mvt] [--cache dir] [--obstacles layer.geojson ...]\n"
+                  << "       reader --roads roads.geojson [--config config.json] [--out graph] [--hdd-budget S] [--hdd-checkpoint file] [--hdd-chunk N]\n"
+                  << "       reader --roads roads.geojson [--config config.json] [--out graph] --mem-budget MB\n"
+                  << "       reader --roads roads.geojson [--config config.json] --serve [--socket path]\n"
+                  << "       reader --roads roads.geojson [--config config.json] --batch configs.ndjson [--out prefix] [--threads N]\n"
+                  << "       reader --roads roads.geojson [--config config.json] --snap points.geojson [--snap-k N] [--snap-radius M] [--snap-check-roads] [--out prefix]\n";
         return 1;
     }
 
-    // чтение
-    Roads roads;
-    if (!io::load_roads_geojson(roads_path, roads))
-    {
-        std::cerr << "Failed to read GeoJSON roads from: " << roads_path << "\n";
-        return 2;
-    }
     Config cfg;
     if (!config_path.empty())
     {
@@ -55,96 +173,189 @@ int main(int argc, char **argv)
         }
     }
 
-    std::cout << "OK: loaded roads\n";
-    std::cout << " polygons: " << roads.polygons.size() << "\n";
-    std::cout << " lines:    " << roads.lines.size() << "\n";
-
-    auto trench = build_trench_strict(roads, cfg.boundary_step);
-    std::cout << "Trench: nodes=" << trench.nodes.size() << ", edges=" << trench.edges.size() << "\n";
+    if (!format.empty())
+        cfg.output_format = format;
 
+    // ограниченная память: дороги целиком не загружаются
+    if (mem_budget_mb > 0.0 && !serve && socket_path.empty() && batch_path.empty() && snap_path.empty())
     {
-        gj::Writer w;
-        for (size_t i = 0; i < trench.nodes.size(); ++i)
-        {
-            w.add_point(
-                trench.nodes[i].x, trench.nodes[i].y,
-                {{"type", "trench"}, {"id", std::to_string(i)}});
-        }
-        save_text(out_base + "_nodes_trench.geojson", w.finish("nodes_trench"));
+        const bool prune = cfg.prune_min_nodes > 0 || cfg.prune_min_length > 0.0;
+        if (cfg.trench_mode == "strict" && cfg.output_format == "geojson" && !prune && cfg.node_order == "input" &&
+            obstacle_paths.empty() && !progressive_on)
+            return run_out_of_core(roads_path, cfg, out_base, (size_t)(mem_budget_mb * 1024 * 1024));
+        std::cerr << "Warning: --mem-budget supports only strict trench mode, geojson output, input node order, "
+                     "no prune_*, no --obstacles and no --hdd-* (building in memory)\n";
     }
 
+    // чтение
+    Session session;
+    session.disk = StageCache(cache_dir);
+    bool loaded;
     {
-        gj::Writer w;
-        for (auto [u, v] : trench.edges)
-        {
-            std::vector<Pt> line{trench.nodes[u], trench.nodes[v]};
-            double L = norm(trench.nodes[v] - trench.nodes[u]);
-            double C = L * cfg.trench_per_m;
-            w.add_line(line, {{"type", "trench"},
-                              {"length", std::to_string(L)},
-                              {"cost", std::to_string(C)}});
-        }
-        save_text(out_base + "_edges_trench.geojson", w.finish("edges_trench"));
+        memtrack::Stage mem_stage("load roads");
+        loaded = session.load(roads_path, cfg, obstacle_paths);
+    }
+    if (!loaded)
+    {
+        std::cerr << "Failed to read GeoJSON roads or obstacles from: " << roads_path << "\n";
+        return 2;
     }
-    std::cout << "Written: " << out_base << "_nodes_trench.geojson, " << out_base << "_edges_trench.geojson\n";
+    const Roads &roads = session.roads;
 
-    HDDParams prm;
+    if (serve || !socket_path.empty())
+    {
+        std::cerr << "OK: loaded roads, polygons: " << roads.polygons.size() << "\n";
+        if (!socket_path.empty())
+            return server::run_socket(session, cfg, socket_path);
+        return server::run_stream(session, cfg, std::cin, std::cout);
+    }
 
-    prm.cross_min = cfg.hdd_min_length;
-    prm.cross_max = cfg.hdd_max_length;
-    prm.cross_angle_tol_deg = cfg.hdd_alpha_deg;
+    std::cout << "OK: loaded roads" << (session.roads_from_disk ? " (from cache)" : "") << "\n";
+    std::cout << " polygons: " << roads.polygons.size() << "\n";
+    std::cout << " lines:    " << roads.lines.size() << "\n";
+    if (!roads.obstacles.empty())
+        std::cout << " obstacles: polygons " << roads.obstacles.polygons.size() << ", line pieces "
+                  << roads.obstacles.lines.size() << "\n";
+    if (session.simplified.vertices_before)
+    {
+        const auto &st = session.simplified;
+        std::cout << "Simplified: vertices " << st.vertices_before << " -> " << st.vertices_after << " (-"
+                  << 100.0 * (st.vertices_before - st.vertices_after) / st.vertices_before << "%), max deviation "
+                  << st.max_deviation << " m, rings kept as is: " << st.rings_kept << "\n";
+    }
 
-    auto hdd = build_hdd_from_trench(roads, trench.nodes, trench.edges, prm);
-    std::cout << "HDD: nodes=" << hdd.nodes.size() << ", edges=" << hdd.edges.size() << "\n";
+    if (!batch_path.empty())
+    {
+        Config base = cfg;
+        base.output_basename = out_base;
+        return run_batch(roads, base, batch_path, threads);
+    }
 
+    // привязка точек к узлам траншей вместо построения выходных файлов графа
+    if (!snap_path.empty())
     {
-        gj::Writer w;
-        for (size_t i = 0; i < hdd.nodes.size(); ++i)
+        std::vector<Pt> points;
+        std::vector<std::string> ids;
+        if (!load_points_geojson(snap_path, points, ids))
         {
-            w.add_point(
-                hdd.nodes[i].x, hdd.nodes[i].y,
-                {{"type", "hdd"}, {"id", std::to_string(i)}});
+            std::cerr << "Failed to read GeoJSON points from: " << snap_path << "\n";
+            return 2;
         }
-        save_text(out_base + "_nodes_hdd.geojson", w.finish("nodes_hdd"));
+        const auto &trench = session.trench(cfg);
+        auto t0 = std::chrono::steady_clock::now();
+        KdTree tree(trench.nodes);
+        if (snap_check_roads)
+            snap.roads = &roads;
+        SnapStats st;
+        auto snaps = snap_points(trench.nodes, tree, points, snap, &st, threads);
+        auto t1 = std::chrono::steady_clock::now();
+        write_snaps(out_base, points, ids, trench.nodes, snaps);
+        std::cout << "Snap: points=" << points.size() << ", trench nodes=" << trench.nodes.size()
+                  << ", snapped=" << st.snapped << ", unsnapped=" << st.unsnapped
+                  << ", rejected crossing roads=" << st.rejected << ", "
+                  << std::chrono::duration<double, std::milli>(t1 - t0).count() << " ms\n";
+        return 0;
     }
 
+    // Конвейер: файлы траншей форматируются, пока строится ГНБ; готовые файлы
+    // пишет на диск отдельная стадия через ограниченную очередь (не больше двух файлов в памяти)
+    Pipeline pipe;
+    BoundedQueue<OutputFile> disk(2);
+    pipe.on_cancel([&]
+                   { disk.close(); });
+    std::mutex out_mu;
+    auto say = [&](const std::string &line)
     {
-        gj::Writer w;
-        for (auto [u, v] : hdd.edges)
+        std::lock_guard<std::mutex> lk(out_mu);
+        std::cout << line << "\n";
+    };
+
+    const TrenchGraph *trench = nullptr;
+    const HDDGraph *hdd = nullptr;
+    HDDGraph hdd_progressive;
+    int st_trench = pipe.add("trench", [&](double &)
+                             {
+        bool cached = false;
+        trench = &session.trench(cfg, &cached);
+        say(trench_line(*trench, cached));
+        if (!cached && session.reordered.nodes)
+            say(node_order_line(cfg, session.reordered)); });
+    int st_hdd = pipe.add("hdd", [&](double &)
+                          {
+        if (progressive_on)
         {
-            std::vector<Pt> line{hdd.nodes[u], hdd.nodes[v]};
-            double L = norm(hdd.nodes[v] - hdd.nodes[u]);
-            double C = L * cfg.hdd_per_m;
-            w.add_line(line, {{"type", "hdd"},
-                              {"length", std::to_string(L)},
-                              {"cost", std::to_string(C)}});
+            say(progressive_hdd_stage(session, cfg, progressive, out_base, hdd_progressive));
+            hdd = &hdd_progressive;
+            return;
         }
-        save_text(out_base + "_edges_hdd.geojson", w.finish("edges_hdd"));
+        bool cached = false;
+        hdd = &session.hdd(cfg, &cached);
+        say("HDD: nodes=" + std::to_string(hdd->nodes.size()) + ", edges=" + std::to_string(hdd->edges.size()) +
+            (cached ? " (from cache)" : "")); }, {st_trench});
+
+    // с порогами prune_* все файлы пишутся из копий без мелких компонент, т.е. после этой стадии
+    const bool prune = cfg.prune_min_nodes > 0 || cfg.prune_min_length > 0.0;
+    TrenchGraph trench_pruned;
+    HDDGraph hdd_pruned;
+    int st_components = pipe.add("components", [&](double &)
+                                 {
+        say(components_stage(cfg, *trench, *hdd, prune ? &trench_pruned : nullptr, &hdd_pruned, threads));
+        if (prune)
+        {
+            trench = &trench_pruned;
+            hdd = &hdd_pruned;
+        } }, {st_hdd});
+    const int st_trench_ready = prune ? st_components : st_trench;
+    const int st_hdd_ready = prune ? st_components : st_hdd;
+
+    // векторные тайлы - одна стадия после компонент вместо файлов GeoJSON/FGB
+    if (cfg.output_format == "mvt")
+    {
+        pipe.add("tiles", [&](double &)
+                 {
+            int tiles = write_tiles(out_base, cfg, *trench, *hdd, nullptr, threads);
+            say("Written: " + out_base + "_tiles/ (" + std::to_string(tiles) + " tiles, zoom " +
+                std::to_string(cfg.tile_min_zoom) + ".." + std::to_string(cfg.tile_max_zoom) + ")"); }, {st_components});
+        pipe.run();
+        pipe.report(std::cout);
+        if (memtrack::installed())
+            memtrack::report(std::cout);
+        return 0;
     }
-    std::cout << "Written: " << out_base << "_nodes_hdd.geojson, "
-              << out_base << "_edges_hdd.geojson\n";
 
+    std::atomic<int> producers{5};
+    auto produce = [&](OutputFile f, double &idle)
     {
-        gj::Writer w;
+        disk.push(std::move(f), &idle);
+        if (--producers == 0)
+            disk.close();
+    };
+    pipe.add("format nodes_trench", [&](double &idle)
+             { produce(format_trench_nodes(out_base, cfg, *trench), idle); }, {st_trench_ready});
+    pipe.add("format edges_trench", [&](double &idle)
+             { produce(format_trench_edges(out_base, cfg, *trench), idle); }, {st_trench_ready});
+    pipe.add("format transitions", [&](double &idle)
+             {
         int transitions = 0;
-        for (size_t i = 0; i < trench.nodes.size(); ++i)
+        OutputFile f = format_transitions(out_base, cfg, *trench, nullptr, &transitions);
+        say("Transitions: " + std::to_string(transitions));
+        produce(std::move(f), idle); }, {st_trench_ready});
+    pipe.add("format nodes_hdd", [&](double &idle)
+             { produce(format_hdd_nodes(out_base, cfg, *hdd), idle); }, {st_hdd_ready});
+    pipe.add("format edges_hdd", [&](double &idle)
+             { produce(format_hdd_edges(out_base, cfg, *hdd), idle); }, {st_hdd_ready});
+    pipe.add("write files", [&](double &idle)
+             {
+        OutputFile f;
+        while (disk.pop(f, &idle))
         {
-            const Pt &p = trench.nodes[i];
-            // std::vector<Pt> zero{p, p}; // нулевая длина и ненулевая стоимость
-            // w.add_line(zero, {{"type", "transition"},
-            //                   {"length", "0"},
-            //                   {"cost", std::to_string(cfg.transition_per_edge)}});
-            w.add_point( // так их видно
-                p.x, p.y,
-                {{"type", "transition"},
-                 {"length", "0"},
-                 {"cost", std::to_string(cfg.transition_per_edge)}});
-            ++transitions;
-        }
-        save_text(out_base + "_edges_transition.geojson", w.finish("edges_transition"));
-        std::cout << "Transitions: " << transitions << "\n";
-        std::cout << "Written: " << out_base << "_edges_transition.geojson\n";
-    }
+            save_text(f.path, f.data);
+            say("Written: " + f.path);
+        } });
 
+    pipe.run();
+    pipe.report(std::cout);
+    if (memtrack::installed())
+        memtrack::report(std::cout);
     return 0;
 }
@@ -0,0 +1,185 @@
+#include "memtrack.h"
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <vector>
+
+// Таблицы фиксированного размера: регистрация метки не должна сама выделять память -
+// иначе замена operator new уходит в рекурсию.
+namespace
+{
+    const int MAX_STAGES = 64;
+    const int MAX_LABELS = 512;
+    const int NAME = 40;
+
+    struct Counters
+    {
+        std::atomic<long long> allocs{0}, bytes{0}, live{0}, peak{0}, largest{0};
+
+        void alloc(long long n)
+        {
+            allocs.fetch_add(1, std::memory_order_relaxed);
+            bytes.fetch_add(n, std::memory_order_relaxed);
+            raise(peak, live.fetch_add(n, std::memory_order_relaxed) + n);
+            raise(largest, n);
+        }
+
+        static void raise(std::atomic<long long> &v, long long x)
+        {
+            long long cur = v.load(std::memory_order_relaxed);
+            while (x > cur && !v.compare_exchange_weak(cur, x, std::memory_order_relaxed))
+                ;
+        }
+    };
+
+    struct LabelInfo
+    {
+        int stage = 0;
+        char container[NAME] = {};
+        Counters c;
+    };
+
+    struct Table
+    {
+        std::mutex mu;
+        std::atomic<bool> installed{false};
+        int n_stages = 1; // 0 - "(no stage)"
+        char stage_name[MAX_STAGES][NAME] = {"(no stage)"};
+        Counters stage[MAX_STAGES];
+        int n_labels = 1; // 0 - без стадии и контейнера
+        LabelInfo label[MAX_LABELS];
+    };
+
+    Table &table()
+    {
+        static Table t;
+        return t;
+    }
+
+    thread_local memtrack::Label cur = 0;
+
+    void copy_name(char *dst, const char *src)
+    {
+        std::strncpy(dst, src ? src : "", NAME - 1);
+        dst[NAME - 1] = 0;
+    }
+
+    // Метка (stage, container); при переполнении таблицы - метка стадии без контейнера или 0
+    memtrack::Label find_label(int stage, const char *container)
+    {
+        Table &t = table();
+        std::lock_guard<std::mutex> lk(t.mu);
+        int fallback = 0;
+        for (int i = 1; i < t.n_labels; ++i)
+            if (t.label[i].stage == stage)
+            {
+                if (std::strncmp(t.label[i].container, container, NAME - 1) == 0)
+                    return i;
+                if (!fallback && std::strcmp(t.label[i].container, "other") == 0)
+                    fallback = i;
+            }
+        if (t.n_labels == MAX_LABELS)
+            return fallback;
+        LabelInfo &l = t.label[t.n_labels];
+        l.stage = stage;
+        copy_name(l.container, container);
+        return t.n_labels++;
+    }
+
+    int find_stage(const char *name)
+    {
+        Table &t = table();
+        std::lock_guard<std::mutex> lk(t.mu);
+        for (int i = 1; i < t.n_stages; ++i)
+            if (std::strncmp(t.stage_name[i], name, NAME - 1) == 0)
+                return i;
+        if (t.n_stages == MAX_STAGES)
+            return 0;
+        copy_name(t.stage_name[t.n_stages], name);
+        return t.n_stages++;
+    }
+}
+
+namespace memtrack
+{
+    Label current() { return cur; }
+    void set_current(Label l) { cur = l; }
+
+    Stage::Stage(const char *name) : prev_(cur)
+    {
+        cur = find_label(find_stage(name), "other");
+    }
+
+    Tag::Tag(const char *container) : prev_(cur)
+    {
+        cur = find_label(table().label[cur].stage, container);
+    }
+
+    bool installed() { return table().installed.load(); }
+
+    namespace hooks
+    {
+        void mark_installed() { table().installed = true; }
+
+        void on_alloc(Label l, size_t bytes)
+        {
+            Table &t = table();
+            t.label[l].c.alloc((long long)bytes);
+            t.stage[t.label[l].stage].alloc((long long)bytes);
+        }
+
+        void on_free(Label l, size_t bytes)
+        {
+            Table &t = table();
+            t.label[l].c.live.fetch_sub((long long)bytes, std::memory_order_relaxed);
+            t.stage[t.label[l].stage].live.fetch_sub((long long)bytes, std::memory_order_relaxed);
+        }
+    }
+
+    void report(std::ostream &os, int containers_per_stage)
+    {
+        if (!installed())
+        {
+            os << "Memory accounting: not built in (configure with -DREADER_MEMTRACK=ON)\n";
+            return;
+        }
+        Table &t = table();
+        int n_stages, n_labels;
+        {
+            std::lock_guard<std::mutex> lk(t.mu);
+            n_stages = t.n_stages;
+            n_labels = t.n_labels;
+        }
+        auto mb = [](long long b)
+        { return b / (1024.0 * 1024.0); };
+        char line[200];
+        os << "Memory by stage (allocations, allocated MB, peak live MB):\n";
+        for (int s = 0; s < n_stages; ++s)
+        {
+            const Counters &c = t.stage[s];
+            if (!c.allocs)
+                continue;
+            std::snprintf(line, sizeof(line), "  %-24s %10lld %10.1f %10.1f\n", t.stage_name[s], c.allocs.load(),
+                          mb(c.bytes), mb(c.peak));
+            os << line;
+
+            std::vector<int> ls;
+            for (int i = 1; i < n_labels; ++i)
+                if (t.label[i].stage == s && t.label[i].c.allocs)
+                    ls.push_back(i);
+            std::sort(ls.begin(), ls.end(), [&](int a, int b)
+                      { return t.label[a].c.peak > t.label[b].c.peak; });
+            if ((int)ls.size() > containers_per_stage)
+                ls.resize(containers_per_stage);
+            for (int i : ls)
+            {
+                const Counters &lc = t.label[i].c;
+                std::snprintf(line, sizeof(line), "    %-22s %10lld %10.1f %10.1f  largest block %.1f MB\n",
+                              t.label[i].container, lc.allocs.load(), mb(lc.bytes), mb(lc.peak), mb(lc.largest));
+                os << line;
+            }
+        }
+    }
+}
@@ -0,0 +1,97 @@
+// Замена глобальных operator new/delete для учёта памяти (memtrack.h). Собирается отдельной
+// библиотекой memtrack (опция CMake READER_MEMTRACK) и подключается только к reader.
+// Перед каждым блоком - заголовок с размером и меткой, чтобы delete знал, с чего списывать.
+#include "memtrack.h"
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+
+namespace
+{
+    struct Header
+    {
+        size_t bytes;
+        int label;
+        int offset; // от начала выделенного блока до пользовательского указателя
+    };
+    static_assert(sizeof(Header) == 16, "header must keep 16-byte alignment");
+
+    void *track_alloc(size_t n, size_t align)
+    {
+        // заголовок сразу перед пользовательским указателем, выравнивание - сдвигом внутри блока
+        size_t head = align > sizeof(Header) ? align : sizeof(Header);
+        size_t extra = align > alignof(std::max_align_t) ? align : 0;
+        char *base = static_cast<char *>(std::malloc(n + head + extra));
+        if (!base)
+            return nullptr;
+        uintptr_t u = reinterpret_cast<uintptr_t>(base) + head;
+        if (extra)
+            u = (u + align - 1) & ~(uintptr_t)(align - 1);
+        char *user = reinterpret_cast<char *>(u);
+        Header *h = reinterpret_cast<Header *>(user) - 1;
+        h->bytes = n;
+        h->label = memtrack::current();
+        h->offset = (int)(user - base);
+        memtrack::hooks::on_alloc(h->label, n);
+        return user;
+    }
+
+    void track_free(void *p)
+    {
+        if (!p)
+            return;
+        Header *h = static_cast<Header *>(p) - 1;
+        memtrack::hooks::on_free(h->label, h->bytes);
+        std::free(static_cast<char *>(p) - h->offset);
+    }
+
+    void *alloc_or_throw(size_t n, size_t align)
+    {
+        while (true)
+        {
+            if (void *p = track_alloc(n ? n : 1, align))
+                return p;
+            std::new_handler nh = std::get_new_handler();
+            if (!nh)
+                throw std::bad_alloc();
+            nh();
+        }
+    }
+
+    const bool registered = (memtrack::hooks::mark_installed(), true);
+}
+
+void *operator new(size_t n) { return alloc_or_throw(n, alignof(std::max_align_t)); }
+void *operator new[](size_t n) { return alloc_or_throw(n, alignof(std::max_align_t)); }
+void *operator new(size_t n, std::align_val_t a) { return alloc_or_throw(n, (size_t)a); }
+void *operator new[](size_t n, std::align_val_t a) { return alloc_or_throw(n, (size_t)a); }
+
+void *operator new(size_t n, const std::nothrow_t &) noexcept
+{
+    return track_alloc(n ? n : 1, alignof(std::max_align_t));
+}
+void *operator new[](size_t n, const std::nothrow_t &) noexcept
+{
+    return track_alloc(n ? n : 1, alignof(std::max_align_t));
+}
+void *operator new(size_t n, std::align_val_t a, const std::nothrow_t &) noexcept
+{
+    return track_alloc(n ? n : 1, (size_t)a);
+}
+void *operator new[](size_t n, std::align_val_t a, const std::nothrow_t &) noexcept
+{
+    return track_alloc(n ? n : 1, (size_t)a);
+}
+
+void operator delete(void *p) noexcept { track_free(p); }
+void operator delete[](void *p) noexcept { track_free(p); }
+void operator delete(void *p, size_t) noexcept { track_free(p); }
+void operator delete[](void *p, size_t) noexcept { track_free(p); }
+void operator delete(void *p, std::align_val_t) noexcept { track_free(p); }
+void operator delete[](void *p, std::align_val_t) noexcept { track_free(p); }
+void operator delete(void *p, size_t, std::align_val_t) noexcept { track_free(p); }
+void operator delete[](void *p, size_t, std::align_val_t) noexcept { track_free(p); }
+void operator delete(void *p, const std::nothrow_t &) noexcept { track_free(p); }
+void operator delete[](void *p, const std::nothrow_t &) noexcept { track_free(p); }
+void operator delete(void *p, std::align_val_t, const std::nothrow_t &) noexcept { track_free(p); }
+void operator delete[](void *p, std::align_val_t, const std::nothrow_t &) noexcept { track_free(p); }
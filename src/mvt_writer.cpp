@@ -0,0 +1,152 @@
+#include "mvt_writer.h"
+#include <cstring>
+
+namespace mvt
+{
+
+    // protobuf: varint, теги (номер поля << 3 | тип), поля с длиной
+    static void put_varint(std::string &o, uint64_t v)
+    {
+        while (v >= 0x80)
+        {
+            o.push_back((char)(v | 0x80));
+            v >>= 7;
+        }
+        o.push_back((char)v);
+    }
+
+    static void put_tag(std::string &o, int field, int wire)
+    {
+        put_varint(o, (uint64_t)(field << 3 | wire));
+    }
+
+    static void put_bytes(std::string &o, int field, const std::string &data)
+    {
+        put_tag(o, field, 2);
+        put_varint(o, data.size());
+        o += data;
+    }
+
+    static void put_packed(std::string &o, int field, const std::vector<uint32_t> &v)
+    {
+        std::string body;
+        for (uint32_t x : v)
+            put_varint(body, x);
+        put_bytes(o, field, body);
+    }
+
+    static uint32_t zigzag(int v)
+    {
+        return ((uint32_t)v << 1) ^ (uint32_t)(v >> 31);
+    }
+
+    static uint32_t command(int id, int count)
+    {
+        return (uint32_t)((id & 0x7) | (count << 3));
+    }
+
+    enum
+    {
+        CMD_MOVE_TO = 1,
+        CMD_LINE_TO = 2
+    };
+    enum
+    {
+        GEOM_POINT = 1,
+        GEOM_LINESTRING = 2
+    };
+
+    void Layer::add_feature(int type, const std::vector<uint32_t> &geometry, const Props &props)
+    {
+        std::vector<uint32_t> tags;
+        tags.reserve(props.size() * 2);
+        for (const auto &[k, v] : props)
+        {
+            auto ki = key_index_.emplace(k, (uint32_t)keys_.size());
+            if (ki.second)
+                keys_.push_back(k);
+            uint64_t bits;
+            std::memcpy(&bits, &v, sizeof(bits));
+            auto vi = value_index_.emplace(bits, (uint32_t)values_.size());
+            if (vi.second)
+                values_.push_back(v);
+            tags.push_back(ki.first->second);
+            tags.push_back(vi.first->second);
+        }
+
+        std::string f;
+        if (!tags.empty())
+            put_packed(f, 2, tags);
+        put_tag(f, 3, 0);
+        put_varint(f, (uint64_t)type);
+        put_packed(f, 4, geometry);
+        put_bytes(features_, 2, f);
+    }
+
+    void Layer::add_point(TilePt p, const Props &props)
+    {
+        add_feature(GEOM_POINT, {command(CMD_MOVE_TO, 1), zigzag(p.first), zigzag(p.second)}, props);
+    }
+
+    void Layer::add_lines(const std::vector<std::vector<TilePt>> &parts, const Props &props)
+    {
+        std::vector<uint32_t> g;
+        int cx = 0, cy = 0;
+        std::vector<TilePt> run;
+        for (const auto &part : parts)
+        {
+            // повторы соседних точек после округления дают нулевые LineTo - убираем
+            run.clear();
+            for (const auto &p : part)
+                if (run.empty() || p != run.back())
+                    run.push_back(p);
+            if (run.size() < 2)
+                continue;
+
+            g.push_back(command(CMD_MOVE_TO, 1));
+            g.push_back(zigzag(run[0].first - cx));
+            g.push_back(zigzag(run[0].second - cy));
+            g.push_back(command(CMD_LINE_TO, (int)run.size() - 1));
+            for (size_t i = 1; i < run.size(); ++i)
+            {
+                g.push_back(zigzag(run[i].first - run[i - 1].first));
+                g.push_back(zigzag(run[i].second - run[i - 1].second));
+            }
+            cx = run.back().first;
+            cy = run.back().second;
+        }
+        if (!g.empty())
+            add_feature(GEOM_LINESTRING, g, props);
+    }
+
+    std::string Layer::encode() const
+    {
+        std::string o;
+        put_tag(o, 15, 0);
+        put_varint(o, 2); // version
+        put_bytes(o, 1, name);
+        o += features_;
+        for (const auto &k : keys_)
+            put_bytes(o, 3, k);
+        for (double v : values_)
+        {
+            std::string val;
+            put_tag(val, 3, 1); // double_value
+            val.append((const char *)&v, sizeof(v));
+            put_bytes(o, 4, val);
+        }
+        put_tag(o, 5, 0);
+        put_varint(o, extent);
+        return o;
+    }
+
+    std::string encode_tile(const std::vector<Layer> &layers)
+    {
+        std::string o;
+        for (const auto &l : layers)
+            if (!l.empty())
+                put_bytes(o, 3, l.encode());
+        return o;
+    }
+
+}
@@ -0,0 +1,77 @@
+#include "roads.h"
+#include "geometry.h"
+#include <algorithm>
+
+void Obstacles::build_index(double mask_cell)
+{
+    // длинные линии режутся на куски, чтобы прямоугольник в индексе был небольшим
+    const size_t PIECE = 16;
+    std::vector<std::vector<Pt>> pieces;
+    for (auto &line : lines)
+    {
+        if (line.size() <= PIECE + 1)
+        {
+            pieces.push_back(std::move(line));
+            continue;
+        }
+        for (size_t k = 0; k + 1 < line.size(); k += PIECE)
+            pieces.emplace_back(line.begin() + k, line.begin() + std::min(line.size(), k + PIECE + 1));
+    }
+    lines.swap(pieces);
+
+    std::vector<BoxGrid::Box> boxes;
+    boxes.reserve(polygons.size() + lines.size());
+    for (auto &poly : polygons)
+    {
+        if (poly.ring.size() >= 64)
+            poly.index.build(poly.ring);
+        if (mask_cell > 0.0)
+            poly.mask.build(poly.ring, mask_cell);
+        boxes.push_back(BoxGrid::box_of(poly.ring));
+    }
+    for (const auto &line : lines)
+        boxes.push_back(BoxGrid::box_of(line));
+    index.build(boxes);
+}
+
+bool Obstacles::contains(Pt p) const
+{
+    if (polygons.empty())
+        return false;
+    thread_local std::vector<int> cand;
+    index.query(BoxGrid::Box{p.x, p.y, p.x, p.y}, cand);
+    for (int i : cand)
+        if (i < (int)polygons.size() && polygon_contains(polygons[i], p))
+            return true;
+    return false;
+}
+
+bool Obstacles::blocks(const Seg &s) const
+{
+    if (empty())
+        return false;
+    thread_local std::vector<int> cand;
+    index.query(s, cand);
+    const int P = (int)polygons.size();
+    for (int i : cand)
+    {
+        if (i < P)
+        {
+            const Polygon &poly = polygons[i];
+            const auto &R = poly.ring;
+            bool hit = for_each_ring_edge_near(poly, s, [&](int k)
+                                               { return seg_intersect(s, {R[k - 1], R[k]}, nullptr); });
+            // без пересечений с границей отрезок целиком внутри или целиком снаружи
+            if (hit || polygon_contains(poly, {(s.a.x + s.b.x) / 2.0, (s.a.y + s.b.y) / 2.0}))
+                return true;
+        }
+        else
+        {
+            const auto &L = lines[i - P];
+            for (size_t k = 1; k < L.size(); ++k)
+                if (seg_intersect(s, {L[k - 1], L[k]}, nullptr))
+                    return true;
+        }
+    }
+    return false;
+}
@@ -0,0 +1,102 @@
+#include "roads.h"
+#include "parallel.h"
+#include <cmath>
+
+void OccupancyMask::build(const std::vector<Pt> &ring, double cell_size, size_t max_cells)
+{
+    cells.clear();
+    nx = ny = 0;
+    if (ring.size() < 4 || cell_size <= 0.0)
+        return;
+
+    double bx0 = ring[0].x, by0 = ring[0].y, bx1 = bx0, by1 = by0;
+    for (const auto &p : ring)
+    {
+        bx0 = std::min(bx0, p.x);
+        by0 = std::min(by0, p.y);
+        bx1 = std::max(bx1, p.x);
+        by1 = std::max(by1, p.y);
+    }
+    double w = bx1 - bx0, h = by1 - by0;
+    cell = std::max(cell_size, std::sqrt(w * h / (double)max_cells));
+    cell = std::max(cell, std::max(w, h) / 4096.0);
+    // ячейка запаса с каждой стороны: граница кольца не выходит на край маски
+    x0 = bx0 - cell;
+    y0 = by0 - cell;
+    nx = (int)std::ceil(w / cell) + 2;
+    ny = (int)std::ceil(h / cell) + 2;
+    cells.assign((size_t)nx * ny, OUTSIDE);
+
+    // граничные ячейки: все, которые задевает ребро, расширенное на m (с запасом на округление)
+    const double m = std::max(10 * ON_SEGMENT_TOL, 1e-12 * std::max(std::fabs(x0), std::fabs(y0)));
+    auto col = [&](double x)
+    { return std::max(0, std::min(nx - 1, (int)std::floor((x - x0) / cell))); };
+    auto row = [&](double y)
+    { return std::max(0, std::min(ny - 1, (int)std::floor((y - y0) / cell))); };
+    for (size_t k = 1; k < ring.size(); ++k)
+    {
+        Pt a = ring[k - 1], b = ring[k];
+        if (a.x > b.x)
+            std::swap(a, b);
+        double dx = b.x - a.x;
+        for (int c = col(a.x - m), c1 = col(b.x + m); c <= c1; ++c)
+        {
+            // часть ребра над столбцом c (по x, с запасом m) и её размах по y
+            double xa = std::max(a.x, x0 + c * cell - m), xb = std::min(b.x, x0 + (c + 1) * cell + m);
+            double ya, yb;
+            if (dx < 1e-12 || xa > xb)
+            {
+                ya = a.y;
+                yb = b.y;
+            }
+            else
+            {
+                ya = a.y + (b.y - a.y) * (xa - a.x) / dx;
+                yb = a.y + (b.y - a.y) * (xb - a.x) / dx;
+            }
+            if (ya > yb)
+                std::swap(ya, yb);
+            for (int r = row(ya - m), r1 = row(yb + m); r <= r1; ++r)
+                cells[(size_t)r * nx + c] = BOUNDARY;
+        }
+    }
+
+    // остальные ячейки - связными областями: граница их не разделяет, поэтому
+    // одна точная проверка центра решает за всю область
+    std::vector<int> stack;
+    std::vector<char> seen(cells.size(), 0);
+    for (size_t start = 0; start < cells.size(); ++start)
+    {
+        if (seen[start] || cells[start] == BOUNDARY)
+            continue;
+        Pt c{x0 + ((int)(start % nx) + 0.5) * cell, y0 + ((int)(start / nx) + 0.5) * cell};
+        uint8_t st = point_in_polygon(c, ring) ? INSIDE : OUTSIDE;
+        stack.assign(1, (int)start);
+        seen[start] = 1;
+        while (!stack.empty())
+        {
+            int i = stack.back();
+            stack.pop_back();
+            cells[i] = st;
+            int x = i % nx, y = i / nx;
+            int nb[4] = {x > 0 ? i - 1 : -1, x + 1 < nx ? i + 1 : -1, y > 0 ? i - nx : -1, y + 1 < ny ? i + nx : -1};
+            for (int j : nb)
+                if (j >= 0 && !seen[j] && cells[j] != BOUNDARY)
+                {
+                    seen[j] = 1;
+                    stack.push_back(j);
+                }
+        }
+    }
+}
+
+void build_occupancy_masks(Roads &roads, double cell, int threads)
+{
+    parallel_for((int)roads.polygons.size(), [&](int i)
+                 {
+        auto &poly = roads.polygons[i];
+        if (cell > 0.0)
+            poly.mask.build(poly.ring, cell);
+        else
+            poly.mask = OccupancyMask{}; }, threads);
+}
@@ -0,0 +1,656 @@
+#include "ooc.h"
+#include "io.h"
+#include "graph.h"
+#include "hdd.h"
+#include "export.h"
+#include "geojson_writer.h"
+#include "spill.h"
+#include "simplify.h"
+#include <cmath>
+#include <filesystem>
+#include <iostream>
+#include <tuple>
+#include <sys/resource.h>
+#include <unistd.h>
+
+namespace fs = std::filesystem;
+
+namespace
+{
+
+    // Ключ склейки узлов - координаты в миллиметрах, как в build_trench_strict
+    struct Key
+    {
+        long long X, Y;
+        bool operator<(const Key &o) const { return X != o.X ? X < o.X : Y < o.Y; }
+        bool operator==(const Key &o) const { return X == o.X && Y == o.Y; }
+    };
+
+    Key key_of(Pt p) { return {llround(p.x * 1000.0), llround(p.y * 1000.0)}; }
+
+    struct Box
+    {
+        double x0, y0, x1, y1;
+
+        // владение - полуоткрытое, чтобы каждая точка принадлежала ровно одному листу
+        bool owns(const Key &k) const
+        {
+            double x = k.X / 1000.0, y = k.Y / 1000.0;
+            return x >= x0 && x < x1 && y >= y0 && y < y1;
+        }
+        bool near(const Box &b, double halo) const
+        {
+            return b.x1 >= x0 - halo && b.x0 <= x1 + halo && b.y1 >= y0 - halo && b.y0 <= y1 + halo;
+        }
+        Box quarter(int k) const
+        {
+            double mx = (x0 + x1) / 2, my = (y0 + y1) / 2;
+            return {k & 1 ? mx : x0, k & 2 ? my : y0, k & 1 ? x1 : mx, k & 2 ? y1 : my};
+        }
+    };
+
+    Box bbox_of(const std::vector<Pt> &ring)
+    {
+        Box b{INFINITY, INFINITY, -INFINITY, -INFINITY};
+        for (const auto &p : ring)
+        {
+            b.x0 = std::min(b.x0, p.x);
+            b.y0 = std::min(b.y0, p.y);
+            b.x1 = std::max(b.x1, p.x);
+            b.y1 = std::max(b.y1, p.y);
+        }
+        return b;
+    }
+
+    // Полигон во временном файле: глобальный номер, число вершин, вершины
+    void write_poly(FILE *f, const std::string &path, int idx, const std::vector<Pt> &ring)
+    {
+        int head[2] = {idx, (int)ring.size()};
+        if (fwrite(head, sizeof(int), 2, f) != 2 || fwrite(ring.data(), sizeof(Pt), ring.size(), f) != ring.size())
+            spill_fail("can't write temporary file", path);
+    }
+
+    FILE *open_spill(const std::string &path)
+    {
+        FILE *f = fopen(path.c_str(), "wb");
+        if (!f)
+            spill_fail("can't create temporary file", path);
+        return f;
+    }
+
+    void close_spill(FILE *f, const std::string &path)
+    {
+        if (fclose(f) != 0)
+            spill_fail("can't write temporary file", path);
+    }
+
+    bool read_poly(FILE *f, int &idx, std::vector<Pt> &ring)
+    {
+        int head[2];
+        if (fread(head, sizeof(int), 2, f) != 2)
+            return false;
+        idx = head[0];
+        ring.resize(head[1]);
+        return fread(ring.data(), sizeof(Pt), ring.size(), f) == ring.size();
+    }
+
+    // Грубая оценка памяти build_trench_strict на полигон: вершины с индексом и точки выборки
+    size_t poly_weight(const std::vector<Pt> &ring, double step)
+    {
+        double per = 0.0;
+        for (size_t k = 1; k < ring.size(); ++k)
+            per += norm(ring[k] - ring[k - 1]);
+        return 64 * ring.size() + 512 * (size_t)(per / std::max(step, 1e-9) + 1);
+    }
+
+    struct Quad
+    {
+        Box box;
+        int child = -1;    // первый из четырёх потомков, -1 - лист
+        std::string polys; // у листа: полигоны, задевающие box с запасом
+        std::string nodes; // у листа: узлы (HNode) с запасом для этапа ГНБ
+    };
+
+    // Записи временных файлов
+    struct NodeRec
+    {
+        Key k;
+        int poly, seg, slot; // NodeOrigin с глобальным номером полигона
+        double x, y;
+    };
+    struct EdgeRec
+    {
+        Key a, b; // a < b
+    };
+    struct KeyId
+    {
+        Key k;
+        int id;
+    };
+    struct HalfEdge
+    {
+        Key b;
+        int a;
+    };
+    struct NodeOut
+    {
+        double x, y;
+    };
+    struct HNode
+    {
+        double x, y;
+        Key k;
+        int id;
+    };
+    struct Cross
+    {
+        int i, seq, j;
+    };
+
+    struct ByKeyOrigin
+    {
+        bool operator()(const NodeRec &a, const NodeRec &b) const
+        {
+            if (!(a.k == b.k))
+                return a.k < b.k;
+            return std::tie(a.poly, a.seg, a.slot) < std::tie(b.poly, b.seg, b.slot);
+        }
+    };
+    struct ByOrigin
+    {
+        bool operator()(const NodeRec &a, const NodeRec &b) const
+        {
+            return std::tie(a.poly, a.seg, a.slot) < std::tie(b.poly, b.seg, b.slot);
+        }
+    };
+    struct ByA
+    {
+        bool operator()(const EdgeRec &a, const EdgeRec &b) const { return a.a < b.a; }
+    };
+    struct ByKey
+    {
+        bool operator()(const KeyId &a, const KeyId &b) const { return a.k < b.k; }
+    };
+    struct ByB
+    {
+        bool operator()(const HalfEdge &a, const HalfEdge &b) const { return a.b < b.b; }
+    };
+    struct ByNodeSeq
+    {
+        bool operator()(const Cross &a, const Cross &b) const { return a.i != b.i ? a.i < b.i : a.seq < b.seq; }
+    };
+
+    // Поиск номеров по ключам, запрашиваемым по возрастанию, в файле KeyId, отсортированном по ключу
+    struct KeyLookup
+    {
+        RecordReader<KeyId> r;
+        KeyId cur{};
+        bool have;
+
+        explicit KeyLookup(const std::string &path) : r(path) { have = r.next(cur); }
+        bool find(const Key &k, int &id)
+        {
+            while (have && cur.k < k)
+                have = r.next(cur);
+            if (!have || !(cur.k == k))
+                return false;
+            id = cur.id;
+            return true;
+        }
+    };
+
+    // Координаты узла по номеру из файла NodeOut
+    struct NodeTable
+    {
+        FILE *f;
+        explicit NodeTable(const std::string &path) : f(fopen(path.c_str(), "rb")) {}
+        ~NodeTable()
+        {
+            if (f)
+                fclose(f);
+        }
+        Pt at(int id)
+        {
+            NodeOut r{};
+            fseek(f, (long)id * (long)sizeof(NodeOut), SEEK_SET);
+            if (fread(&r, sizeof(r), 1, f) != 1)
+                return {};
+            return {r.x, r.y};
+        }
+    };
+
+    void load_leaf_polys(const std::string &path, double mask_cell, Roads &sub, std::vector<int> &gidx)
+    {
+        FILE *f = fopen(path.c_str(), "rb");
+        if (!f)
+            return;
+        int idx;
+        std::vector<Pt> ring;
+        while (read_poly(f, idx, ring))
+        {
+            sub.polygons.push_back({ring, {}, {}});
+            gidx.push_back(idx);
+        }
+        fclose(f);
+        build_ring_indexes(sub);
+        build_occupancy_masks(sub, mask_cell, 1);
+    }
+
+    // Раскладывает узлы файла path по листам поддерева q (узел попадает во все листы в пределах halo)
+    void distribute_nodes(std::vector<Quad> &tree, int q, const std::string &path, double halo,
+                          const std::string &dir)
+    {
+        if (tree[q].child < 0)
+        {
+            tree[q].nodes = path;
+            return;
+        }
+        int c = tree[q].child;
+        std::string sub[4];
+        {
+            std::unique_ptr<RecordWriter<HNode>> w[4];
+            for (int k = 0; k < 4; ++k)
+            {
+                sub[k] = spill_path(dir, "nodes");
+                w[k].reset(new RecordWriter<HNode>(sub[k]));
+            }
+            RecordReader<HNode> r(path);
+            HNode n;
+            while (r.next(n))
+                for (int k = 0; k < 4; ++k)
+                    if (tree[c + k].box.near({n.x, n.y, n.x, n.y}, halo))
+                        w[k]->push(n);
+            for (auto &wk : w)
+                wk->close();
+        }
+        std::remove(path.c_str());
+        for (int k = 0; k < 4; ++k)
+            distribute_nodes(tree, c + k, sub[k], halo, dir);
+    }
+
+    long peak_rss_mb()
+    {
+        rusage ru{};
+        getrusage(RUSAGE_SELF, &ru);
+        return ru.ru_maxrss / 1024; // Linux: в килобайтах
+    }
+
+}
+
+static int build_out_of_core(const std::string &roads_path, const Config &cfg, const std::string &out_base,
+                             size_t budget_bytes)
+{
+    std::error_code ec;
+    const fs::path tmp = fs::temp_directory_path(ec) / ("reader-ooc-" + std::to_string(getpid()));
+    fs::create_directories(tmp, ec);
+    const std::string dir = tmp.string();
+    struct Cleanup
+    {
+        fs::path p;
+        ~Cleanup()
+        {
+            std::error_code e;
+            fs::remove_all(p, e);
+        }
+    } cleanup{tmp};
+
+    const double step = cfg.boundary_step;
+    const HDDParams prm = make_hdd_params(cfg);
+    // В лист попадает всё, что ближе halo: рёбра траншей короче 2 шагов выборки,
+    // поперечные рёбра ГНБ - не длиннее cross_max
+    const double halo_trench = 3.0 * step + 1.0;
+    const double halo_hdd = prm.cross_max + 1.0;
+    const double halo = std::max(halo_trench, halo_hdd);
+    const size_t leaf_limit = budget_bytes / 3;
+    const size_t sort_mem = budget_bytes / 8;
+    const int MAX_DEPTH = 16;
+
+    // 1. Потоковое чтение: полигоны и мультиполигоны - в отдельные файлы, чтобы номера
+    //    шли в том же порядке, что у io::parse_roads_geojson (сначала все Polygon)
+    const std::string part_path[2] = {spill_path(dir, "poly"), spill_path(dir, "multi")};
+    size_t n_lines = 0, n_poly = 0;
+    Box ext{INFINITY, INFINITY, -INFINITY, -INFINITY};
+    {
+        FILE *part[2] = {open_spill(part_path[0]), open_spill(part_path[1])};
+        bool read = io::for_each_feature(roads_path, [&](const std::string &text)
+                                         {
+            Roads r;
+            io::parse_roads_geojson(text, r);
+            n_lines += r.lines.size();
+            const int m = text.find("\"MultiPolygon\"") != std::string::npos ? 1 : 0;
+            for (auto &p : r.polygons)
+            {
+                if (cfg.simplify_tolerance > 0.0)
+                    simplify_ring(p.ring, cfg.simplify_tolerance);
+                write_poly(part[m], part_path[m], 0, p.ring);
+                Box b = bbox_of(p.ring);
+                ext = {std::min(ext.x0, b.x0), std::min(ext.y0, b.y0), std::max(ext.x1, b.x1), std::max(ext.y1, b.y1)};
+                ++n_poly;
+            } });
+        close_spill(part[0], part_path[0]);
+        close_spill(part[1], part_path[1]);
+        if (!read || (n_poly == 0 && n_lines == 0))
+        {
+            std::cerr << "Failed to read GeoJSON roads from: " << roads_path << "\n";
+            return 2;
+        }
+    }
+    std::cout << "OK: streamed roads\n";
+    std::cout << " polygons: " << n_poly << "\n";
+    std::cout << " lines:    " << n_lines << "\n";
+
+    // 2. Квадродерево: лист делится, пока оценка памяти его полигонов больше leaf_limit
+    std::vector<Quad> tree(1);
+    tree[0].box = {ext.x0 - 1.0, ext.y0 - 1.0, ext.x1 + 1.0, ext.y1 + 1.0};
+    tree[0].polys = spill_path(dir, "poly");
+    std::vector<size_t> weight(1, 0);
+    {
+        FILE *root = open_spill(tree[0].polys);
+        int gidx = 0, idx;
+        std::vector<Pt> ring;
+        for (const auto &path : part_path)
+        {
+            FILE *f = fopen(path.c_str(), "rb");
+            while (f && read_poly(f, idx, ring))
+            {
+                write_poly(root, tree[0].polys, gidx++, ring);
+                weight[0] += poly_weight(ring, step);
+            }
+            if (f)
+                fclose(f);
+            std::remove(path.c_str());
+        }
+        close_spill(root, tree[0].polys);
+    }
+
+    std::vector<std::pair<int, int>> todo{{0, 0}};
+    while (!todo.empty())
+    {
+        auto [q, depth] = todo.back();
+        todo.pop_back();
+        // части уже halo почти целиком повторяли бы родителя
+        const Box &bq = tree[q].box;
+        if (weight[q] <= leaf_limit || depth >= MAX_DEPTH || std::min(bq.x1 - bq.x0, bq.y1 - bq.y0) < 2 * halo)
+            continue;
+
+        int c = (int)tree.size();
+        size_t w[4] = {0, 0, 0, 0};
+        {
+            FILE *out[4];
+            for (int k = 0; k < 4; ++k)
+            {
+                Quad child;
+                child.box = tree[q].box.quarter(k);
+                child.polys = spill_path(dir, "poly");
+                out[k] = open_spill(child.polys);
+                tree.push_back(child);
+            }
+            FILE *in = fopen(tree[q].polys.c_str(), "rb");
+            int idx;
+            std::vector<Pt> ring;
+            while (in && read_poly(in, idx, ring))
+            {
+                Box b = bbox_of(ring);
+                size_t pw = poly_weight(ring, step);
+                for (int k = 0; k < 4; ++k)
+                    if (tree[c + k].box.near(b, halo))
+                    {
+                        write_poly(out[k], tree[c + k].polys, idx, ring);
+                        w[k] += pw;
+                    }
+            }
+            if (in)
+                fclose(in);
+            for (int k = 0; k < 4; ++k)
+                close_spill(out[k], tree[c + k].polys);
+        }
+
+        // каждый полигон задевает все четыре части - деление ничего не даёт
+        if (w[0] == weight[q] && w[1] == weight[q] && w[2] == weight[q] && w[3] == weight[q])
+        {
+            for (int k = 0; k < 4; ++k)
+                std::remove(tree[c + k].polys.c_str());
+            tree.resize(c);
+            continue;
+        }
+        std::remove(tree[q].polys.c_str());
+        tree[q].polys.clear();
+        tree[q].child = c;
+        for (int k = 0; k < 4; ++k)
+        {
+            weight.push_back(w[k]);
+            todo.push_back({c + k, depth + 1});
+        }
+    }
+    int leaves = 0;
+    for (const auto &qd : tree)
+        leaves += qd.child < 0;
+
+    // 3. Траншеи по листам: узлы и рёбра, которыми лист владеет, - в сортировщики
+    ExternalSorter<NodeRec, ByKeyOrigin> node_sort(dir, sort_mem);
+    ExternalSorter<EdgeRec, ByA> edge_sort(dir, sort_mem);
+    for (const auto &qd : tree)
+    {
+        if (qd.child >= 0)
+            continue;
+        Roads sub;
+        std::vector<int> gidx;
+        load_leaf_polys(qd.polys, cfg.mask_cell, sub, gidx);
+        if (sub.polygons.empty())
+            continue;
+
+        std::vector<NodeOrigin> origin;
+        TrenchGraph g = build_trench_strict(sub, step, &origin);
+        std::vector<Key> keys(g.nodes.size());
+        for (size_t i = 0; i < g.nodes.size(); ++i)
+        {
+            keys[i] = key_of(g.nodes[i]);
+            if (qd.box.owns(keys[i]))
+                node_sort.push({keys[i], gidx[origin[i].poly], origin[i].seg, origin[i].slot,
+                                g.nodes[i].x, g.nodes[i].y});
+        }
+        for (auto [u, v] : g.edges)
+        {
+            Key a = keys[u], b = keys[v];
+            if (b < a)
+                std::swap(a, b);
+            if (qd.box.owns(a))
+                edge_sort.push({a, b});
+        }
+    }
+
+    // 4. Склейка узлов (первое появление по (полигон, отрезок, место) задаёт координату и номер)
+    ExternalSorter<NodeRec, ByOrigin> origin_sort(dir, sort_mem);
+    {
+        bool first = true;
+        Key last{};
+        node_sort.drain([&](const NodeRec &r)
+                        {
+            if (!first && r.k == last)
+                return;
+            first = false;
+            last = r.k;
+            origin_sort.push(r); });
+    }
+    const std::string nodes_path = spill_path(dir, "nodes"), keys_path = spill_path(dir, "keys"),
+                      hnodes_path = spill_path(dir, "nodes");
+    int n_nodes = 0;
+    {
+        ExternalSorter<KeyId, ByKey> key_sort(dir, sort_mem);
+        {
+            RecordWriter<NodeOut> nodes(nodes_path);
+            RecordWriter<HNode> hnodes(hnodes_path);
+            origin_sort.drain([&](const NodeRec &r)
+                              {
+                nodes.push({r.x, r.y});
+                hnodes.push({r.x, r.y, r.k, n_nodes});
+                key_sort.push({r.k, n_nodes});
+                ++n_nodes; });
+            nodes.close();
+            hnodes.close();
+        }
+        RecordWriter<KeyId> keys(keys_path);
+        key_sort.drain([&](const KeyId &k)
+                       { keys.push(k); });
+        keys.close();
+    }
+
+    // 5. Рёбра: ключи концов -> номера (два прохода слияния с файлом ключей), затем (u < v) и без повторов
+    const std::string edges_path = spill_path(dir, "edges");
+    size_t n_edges = 0, unresolved = 0;
+    {
+        ExternalSorter<HalfEdge, ByB> half_sort(dir, sort_mem);
+        {
+            KeyLookup look(keys_path);
+            edge_sort.drain([&](const EdgeRec &e)
+                            {
+                int a;
+                if (look.find(e.a, a))
+                    half_sort.push({e.b, a});
+                else
+                    ++unresolved; });
+        }
+        ExternalSorter<std::pair<int, int>> pair_sort(dir, sort_mem);
+        {
+            KeyLookup look(keys_path);
+            half_sort.drain([&](const HalfEdge &h)
+                            {
+                int b;
+                if (look.find(h.b, b))
+                    pair_sort.push({std::min(h.a, b), std::max(h.a, b)});
+                else
+                    ++unresolved; });
+        }
+        RecordWriter<std::pair<int, int>> edges(edges_path);
+        bool first = true;
+        std::pair<int, int> last{};
+        pair_sort.drain([&](const std::pair<int, int> &e)
+                        {
+            if (!first && e == last)
+                return;
+            first = false;
+            last = e;
+            if (e.first != e.second)
+                edges.push(e); });
+        edges.close();
+        n_edges = edges.count();
+    }
+    std::remove(keys_path.c_str());
+    if (unresolved)
+        std::cerr << "Warning: out-of-core: " << unresolved << " trench edge ends without a node\n";
+    std::cout << "Trench: nodes=" << n_nodes << ", edges=" << n_edges << "\n";
+
+    // 6. Поперечные рёбра ГНБ по листам: узел - в листе-владельце, соседи - из запаса halo_hdd
+    distribute_nodes(tree, 0, hnodes_path, halo_hdd, dir);
+    const std::string cross_path = spill_path(dir, "cross");
+    size_t n_cross = 0;
+    {
+        ExternalSorter<Cross, ByNodeSeq> cross_sort(dir, sort_mem);
+        for (const auto &qd : tree)
+        {
+            if (qd.child >= 0)
+                continue;
+            std::vector<Pt> pts;
+            std::vector<int> ids;
+            std::vector<char> own;
+            {
+                RecordReader<HNode> r(qd.nodes);
+                HNode n;
+                while (r.next(n))
+                {
+                    pts.push_back({n.x, n.y});
+                    ids.push_back(n.id);
+                    own.push_back(qd.box.owns(n.k));
+                }
+            }
+            std::remove(qd.nodes.c_str());
+            if (pts.empty())
+                continue;
+            Roads sub;
+            std::vector<int> gidx;
+            load_leaf_polys(qd.polys, cfg.mask_cell, sub, gidx);
+
+            // номера в листе идут в том же порядке, что и глобальные, поэтому
+            // направление рёбер и порядок соседей - как в build_hdd_from_trench
+            LazyHDD lazy(sub, pts, prm);
+            for (int i = 0; i < (int)pts.size(); ++i)
+            {
+                if (!own[i])
+                    continue;
+                int seq = 0;
+                for (int j : lazy.cross_neighbours(i))
+                    if (ids[j] > ids[i])
+                        cross_sort.push({ids[i], seq++, ids[j]});
+            }
+        }
+        RecordWriter<std::pair<int, int>> cross(cross_path);
+        cross_sort.drain([&](const Cross &c)
+                         { cross.push({c.i, c.j}); });
+        cross.close();
+        n_cross = cross.count();
+    }
+    for (const auto &qd : tree)
+        if (qd.child < 0)
+            std::remove(qd.polys.c_str());
+
+    // 7. Вывод - потоком
+    const std::string ext_name = ".geojson";
+    NodeTable table(nodes_path);
+    auto write_nodes = [&](const std::string &name, const char *type, bool transition)
+    {
+        gj::StreamWriter w(out_base + "_" + name + ext_name, name);
+        RecordReader<NodeOut> r(nodes_path);
+        NodeOut n;
+        for (int id = 0; r.next(n); ++id)
+            w.add_point(n.x, n.y, transition ? transition_props(cfg) : node_props(type, id));
+    };
+    auto write_edges = [&](gj::StreamWriter &w, const std::string &path, const char *type, double price)
+    {
+        RecordReader<std::pair<int, int>> r(path);
+        std::pair<int, int> e;
+        while (r.next(e))
+        {
+            std::vector<Pt> line{table.at(e.first), table.at(e.second)};
+            w.add_line(line, edge_props(type, norm(line[1] - line[0]), price));
+        }
+    };
+
+    write_nodes("nodes_trench", "trench", false);
+    {
+        gj::StreamWriter w(out_base + "_edges_trench" + ext_name, "edges_trench");
+        write_edges(w, edges_path, "trench", cfg.trench_per_m);
+    }
+    std::cout << "Written: " << out_base << "_nodes_trench" << ext_name << ", " << out_base << "_edges_trench" << ext_name << "\n";
+
+    std::cout << "HDD: nodes=" << n_nodes << ", edges=" << n_edges + n_cross << "\n";
+    write_nodes("nodes_hdd", "hdd", false);
+    {
+        gj::StreamWriter w(out_base + "_edges_hdd" + ext_name, "edges_hdd");
+        write_edges(w, edges_path, "hdd", cfg.hdd_per_m);
+        write_edges(w, cross_path, "hdd", cfg.hdd_per_m);
+    }
+    std::cout << "Written: " << out_base << "_nodes_hdd" << ext_name << ", " << out_base << "_edges_hdd" << ext_name << "\n";
+
+    write_nodes("edges_transition", nullptr, true);
+    std::cout << "Transitions: " << n_nodes << "\n";
+    std::cout << "Written: " << out_base << "_edges_transition" << ext_name << "\n";
+
+    std::cout << "Out-of-core: partitions=" << leaves << ", peak RSS=" << peak_rss_mb()
+              << " MB (budget " << budget_bytes / (1024.0 * 1024.0) << " MB)\n";
+    return 0;
+}
+
+int run_out_of_core(const std::string &roads_path, const Config &cfg, const std::string &out_base,
+                    size_t budget_bytes)
+{
+    try
+    {
+        return build_out_of_core(roads_path, cfg, out_base, budget_bytes);
+    }
+    catch (const SpillError &e)
+    {
+        // например, кончилось место на диске: обрезанные временные файлы дали бы неверный граф
+        std::cerr << "Out-of-core build failed: " << e.what() << "\n";
+        return 2;
+    }
+}
@@ -0,0 +1,209 @@
+#include "outline.h"
+#include "geometry.h"
+#include <algorithm>
+#include <cmath>
+#include <map>
+
+struct Box
+{
+    double x0, y0, x1, y1;
+};
+
+static Box seg_box(Pt a, Pt b)
+{
+    return {std::min(a.x, b.x), std::min(a.y, b.y), std::max(a.x, b.x), std::max(a.y, b.y)};
+}
+
+static Box ring_box(const std::vector<Pt> &ring)
+{
+    Box b{1e300, 1e300, -1e300, -1e300};
+    for (const auto &p : ring)
+    {
+        b.x0 = std::min(b.x0, p.x);
+        b.y0 = std::min(b.y0, p.y);
+        b.x1 = std::max(b.x1, p.x);
+        b.y1 = std::max(b.y1, p.y);
+    }
+    return b;
+}
+
+static bool boxes_overlap(const Box &a, const Box &b, double eps)
+{
+    return a.x0 <= b.x1 + eps && b.x0 <= a.x1 + eps && a.y0 <= b.y1 + eps && b.y0 <= a.y1 + eps;
+}
+
+static double dist_to_seg(Pt p, Pt a, Pt b)
+{
+    Pt ab = b - a;
+    double den = norm2(ab);
+    double t = den > 0 ? std::max(0.0, std::min(1.0, dot(p - a, ab) / den)) : 0.0;
+    return norm(p - (a + ab * t));
+}
+
+static bool inside_union(Pt p, const Roads &roads, const std::vector<Box> &boxes)
+{
+    for (int i = 0; i < (int)roads.polygons.size(); ++i)
+    {
+        const Box &b = boxes[i];
+        if (p.x < b.x0 || p.x > b.x1 || p.y < b.y0 || p.y > b.y1)
+            continue;
+        if (polygon_contains(roads.polygons[i], p))
+            return true;
+    }
+    return false;
+}
+
+static bool on_boundary_of(Pt p, const Polygon &poly, double tol)
+{
+    const auto &R = poly.ring;
+    return for_each_ring_edge_near(poly, {p, p}, [&](int k)
+                                   { return dist_to_seg(p, R[k - 1], R[k]) < tol; });
+}
+
+struct Cut
+{
+    double t;
+    Pt p;
+};
+
+std::vector<std::vector<Pt>> union_outline(const Roads &roads, int *open_rings)
+{
+    const double EPS_PT = 1e-7;   // совпадение точек, м
+    const double EPS_SIDE = 1e-5; // смещение пробных точек по нормали, м
+    const double EPS_SHARED = 1e-6;
+
+    int N = (int)roads.polygons.size();
+    std::vector<Box> boxes(N);
+    for (int i = 0; i < N; ++i)
+        boxes[i] = ring_box(roads.polygons[i].ring);
+
+    // куски границ, лежащие на границе объединения, ориентированные внутренностью влево
+    std::vector<std::pair<Pt, Pt>> pieces;
+
+    for (int i = 0; i < N; ++i)
+    {
+        const auto &R = roads.polygons[i].ring;
+        for (size_t k = 1; k < R.size(); ++k)
+        {
+            Seg e{R[k - 1], R[k]};
+            Pt d = e.b - e.a;
+            double L2 = norm2(d);
+            if (L2 < EPS_PT * EPS_PT)
+                continue;
+            Box eb = seg_box(e.a, e.b);
+
+            std::vector<Cut> cuts{{0.0, e.a}, {1.0, e.b}};
+            auto add_cut = [&](Pt p)
+            {
+                double t = dot(p - e.a, d) / L2;
+                if (t > 0.0 && t < 1.0)
+                    cuts.push_back({t, p});
+            };
+
+            for (int j = 0; j < N; ++j)
+            {
+                if (j == i || !boxes_overlap(eb, boxes[j], EPS_PT))
+                    continue;
+                const auto &Q = roads.polygons[j].ring;
+                for_each_ring_edge_near(roads.polygons[j], e, [&](int m)
+                                        {
+                    Seg f{Q[m - 1], Q[m]};
+                    if (!boxes_overlap(eb, seg_box(f.a, f.b), EPS_PT))
+                        return false;
+                    // точку пересечения считаем в одном порядке аргументов для обоих полигонов,
+                    // чтобы концы кусков совпадали побитово
+                    Pt ip;
+                    bool hit = i < j ? seg_intersect(e, f, &ip) : seg_intersect(f, e, &ip);
+                    if (hit)
+                        add_cut(ip);
+                    if (on_segment(f.a, e))
+                        add_cut(f.a);
+                    if (on_segment(f.b, e))
+                        add_cut(f.b);
+                    return false; });
+            }
+
+            std::sort(cuts.begin(), cuts.end(), [](const Cut &u, const Cut &v)
+                      { return u.t < v.t; });
+
+            for (size_t c = 1; c < cuts.size(); ++c)
+            {
+                Pt p0 = cuts[c - 1].p, p1 = cuts[c].p;
+                if (norm(p1 - p0) < EPS_PT)
+                    continue;
+                Pt m{(p0.x + p1.x) / 2.0, (p0.y + p1.y) / 2.0};
+                Pt n = Pt{-d.y, d.x} * (1.0 / std::sqrt(L2));
+
+                bool inL = inside_union(m + n * EPS_SIDE, roads, boxes);
+                bool inR = inside_union(m - n * EPS_SIDE, roads, boxes);
+                if (inL == inR)
+                    continue;
+
+                // общий участок границы нескольких полигонов берём от полигона с меньшим индексом
+                bool shared = false;
+                for (int j = 0; j < i && !shared; ++j)
+                {
+                    if (boxes_overlap(seg_box(m, m), boxes[j], EPS_SHARED))
+                        shared = on_boundary_of(m, roads.polygons[j], EPS_SHARED);
+                }
+                if (shared)
+                    continue;
+
+                if (inL)
+                    pieces.emplace_back(p0, p1);
+                else
+                    pieces.emplace_back(p1, p0);
+            }
+        }
+    }
+
+    // сборка кусков в замкнутые контуры
+    auto key = [](Pt p)
+    { return std::make_pair(llround(p.x * 1000.0), llround(p.y * 1000.0)); };
+
+    std::map<std::pair<long long, long long>, std::vector<int>> starts;
+    for (int k = 0; k < (int)pieces.size(); ++k)
+        starts[key(pieces[k].first)].push_back(k);
+
+    std::vector<char> used(pieces.size(), 0);
+    std::vector<std::vector<Pt>> rings;
+    if (open_rings)
+        *open_rings = 0;
+
+    for (int k0 = 0; k0 < (int)pieces.size(); ++k0)
+    {
+        if (used[k0])
+            continue;
+        std::vector<Pt> ring{pieces[k0].first};
+        auto start = key(pieces[k0].first);
+        int k = k0;
+        while (k >= 0)
+        {
+            used[k] = 1;
+            ring.push_back(pieces[k].second);
+            auto kb = key(pieces[k].second);
+            if (kb == start)
+                break;
+            int next = -1;
+            auto it = starts.find(kb);
+            if (it != starts.end())
+            {
+                for (int c : it->second)
+                    if (!used[c])
+                    {
+                        next = c;
+                        break;
+                    }
+            }
+            k = next;
+        }
+        if (ring.size() >= 4 && key(ring.back()) == start)
+        {
+            ring.back() = ring.front();
+            rings.push_back(std::move(ring));
+        }
+        else if (open_rings)
+            ++*open_rings;
+    }
+    return rings;
+}
@@ -0,0 +1,101 @@
+#include "pipeline.h"
+#include "memtrack.h"
+#include <algorithm>
+#include <cstdio>
+#include <future>
+#include <thread>
+
+int Pipeline::add(const std::string &name, StageFn f, std::vector<int> deps)
+{
+    Stage s;
+    s.name = name;
+    s.f = std::move(f);
+    s.deps = std::move(deps);
+    stages_.push_back(std::move(s));
+    return (int)stages_.size() - 1;
+}
+
+void Pipeline::run()
+{
+    using clock = std::chrono::steady_clock;
+    const auto t0 = clock::now();
+    auto since = [&]
+    { return std::chrono::duration<double>(clock::now() - t0).count(); };
+
+    const size_t n = stages_.size();
+    std::vector<std::promise<bool>> done(n); // true - стадия выполнена успешно
+    std::vector<std::shared_future<bool>> ok;
+    for (auto &p : done)
+        ok.push_back(p.get_future().share());
+
+    std::mutex mu;
+    std::exception_ptr error;
+    auto cancel = [&]
+    {
+        for (auto &f : cancel_)
+            f();
+    };
+
+    std::vector<std::thread> threads;
+    threads.reserve(n);
+    for (size_t i = 0; i < n; ++i)
+        threads.emplace_back([&, i]
+                             {
+            Stage &s = stages_[i];
+            bool deps_ok = true;
+            for (int d : s.deps)
+                deps_ok = ok[d].get() && deps_ok;
+            if (!deps_ok)
+            {
+                done[i].set_value(false);
+                return;
+            }
+            s.start = since();
+            memtrack::Stage mem_stage(s.name.c_str());
+            bool good = true;
+            try
+            {
+                s.f(s.idle);
+            }
+            catch (...)
+            {
+                good = false;
+                std::lock_guard<std::mutex> lk(mu);
+                if (!error)
+                    error = std::current_exception();
+            }
+            s.end = since();
+            s.ran = true;
+            if (!good)
+                cancel();
+            done[i].set_value(good); });
+
+    for (auto &t : threads)
+        t.join();
+    wall_ = since();
+    if (error)
+        std::rethrow_exception(error);
+}
+
+void Pipeline::report(std::ostream &os) const
+{
+    char line[160];
+    double work = 0.0;
+    os << "Pipeline stages (start - end, busy):\n";
+    for (const auto &s : stages_)
+    {
+        if (!s.ran)
+        {
+            os << "  " << s.name << ": not run\n";
+            continue;
+        }
+        double busy = std::max(0.0, s.end - s.start - s.idle);
+        work += busy;
+        std::snprintf(line, sizeof(line), "  %-22s %7.3f - %7.3f s  busy %7.3f s (%3.0f%%)\n", s.name.c_str(),
+                      s.start, s.end, busy, wall_ > 0 ? 100.0 * busy / wall_ : 0.0);
+        os << line;
+    }
+    std::snprintf(line, sizeof(line), "  total: %.3f s of stage work in %.3f s wall (overlap x%.2f)\n", work, wall_,
+                  wall_ > 0 ? work / wall_ : 0.0);
+    os << line;
+}
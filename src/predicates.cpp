@@ -0,0 +1,176 @@
+#include "predicates.h"
+#include <cmath>
+
+namespace pred
+{
+
+    static const double EPSILON = 1.1102230246251565e-16; // 2^-53
+    static const double SPLITTER = 134217729.0;           // 2^27 + 1
+    static const double CCW_ERRBOUND_A = (3.0 + 16.0 * EPSILON) * EPSILON;
+
+    static inline void fast_two_sum(double a, double b, double &x, double &y)
+    {
+        x = a + b;
+        double bv = x - a;
+        y = b - bv;
+    }
+
+    static inline void two_sum(double a, double b, double &x, double &y)
+    {
+        x = a + b;
+        double bv = x - a;
+        double av = x - bv;
+        y = (a - av) + (b - bv);
+    }
+
+    static inline void two_diff(double a, double b, double &x, double &y)
+    {
+        x = a - b;
+        double bv = a - x;
+        double av = x + bv;
+        y = (a - av) + (bv - b);
+    }
+
+    static inline void split(double a, double &hi, double &lo)
+    {
+        double c = SPLITTER * a;
+        double abig = c - a;
+        hi = c - abig;
+        lo = a - hi;
+    }
+
+    static inline void two_product(double a, double b, double &x, double &y)
+    {
+        x = a * b;
+        double ahi, alo, bhi, blo;
+        split(a, ahi, alo);
+        split(b, bhi, blo);
+        double err1 = x - (ahi * bhi);
+        double err2 = err1 - (alo * bhi);
+        double err3 = err2 - (ahi * blo);
+        y = (alo * blo) - err3;
+    }
+
+    // Разложения хранятся по возрастанию модуля, без нулевых компонент.
+
+    static int diff_expansion(double a, double b, double *h)
+    {
+        double x, y;
+        two_diff(a, b, x, y);
+        int n = 0;
+        if (y != 0.0)
+            h[n++] = y;
+        if (x != 0.0 || n == 0)
+            h[n++] = x;
+        return n;
+    }
+
+    static int scale_expansion(int elen, const double *e, double b, double *h)
+    {
+        double Q, hh, p1, p0, sum;
+        int n = 0;
+        two_product(e[0], b, Q, hh);
+        if (hh != 0.0)
+            h[n++] = hh;
+        for (int i = 1; i < elen; ++i)
+        {
+            two_product(e[i], b, p1, p0);
+            two_sum(Q, p0, sum, hh);
+            if (hh != 0.0)
+                h[n++] = hh;
+            fast_two_sum(p1, sum, Q, hh);
+            if (hh != 0.0)
+                h[n++] = hh;
+        }
+        if (Q != 0.0 || n == 0)
+            h[n++] = Q;
+        return n;
+    }
+
+    // h = e + f (h может не совпадать с e и f)
+    static int sum_expansion(int elen, const double *e, int flen, const double *f, double *h)
+    {
+        double buf[2][32];
+        int n = elen;
+        const double *cur = e;
+        int which = 0;
+        for (int k = 0; k < flen; ++k)
+        {
+            double *out = (k == flen - 1) ? h : buf[which];
+            double Q = f[k], Qn, hh;
+            int m = 0;
+            for (int i = 0; i < n; ++i)
+            {
+                two_sum(Q, cur[i], Qn, hh);
+                Q = Qn;
+                if (hh != 0.0)
+                    out[m++] = hh;
+            }
+            if (Q != 0.0 || m == 0)
+                out[m++] = Q;
+            cur = out;
+            n = m;
+            which ^= 1;
+        }
+        if (flen == 0)
+            for (int i = 0; i < n; ++i)
+                h[i] = e[i];
+        return n;
+    }
+
+    static int orient2d_exact(double ax, double ay, double bx, double by, double cx, double cy)
+    {
+        double acx[2], bcy[2], acy[2], bcx[2];
+        int nacx = diff_expansion(ax, cx, acx);
+        int nbcy = diff_expansion(by, cy, bcy);
+        int nacy = diff_expansion(ay, cy, acy);
+        int nbcx = diff_expansion(bx, cx, bcx);
+
+        // left = acx * bcy
+        double t[2][4], left[8], right[8], det[16];
+        int nt0 = scale_expansion(nacx, acx, bcy[0], t[0]);
+        int nt1 = nbcy > 1 ? scale_expansion(nacx, acx, bcy[1], t[1]) : 0;
+        int nl = sum_expansion(nt0, t[0], nt1, t[1], left);
+
+        // right = -(acy * bcx)
+        for (int i = 0; i < nbcx; ++i)
+            bcx[i] = -bcx[i];
+        nt0 = scale_expansion(nacy, acy, bcx[0], t[0]);
+        nt1 = nbcx > 1 ? scale_expansion(nacy, acy, bcx[1], t[1]) : 0;
+        int nr = sum_expansion(nt0, t[0], nt1, t[1], right);
+
+        int nd = sum_expansion(nl, left, nr, right, det);
+        double top = det[nd - 1];
+        return (top > 0.0) - (top < 0.0);
+    }
+
+    int orient2d(double ax, double ay, double bx, double by, double cx, double cy)
+    {
+        double detleft = (ax - cx) * (by - cy);
+        double detright = (ay - cy) * (bx - cx);
+        double det = detleft - detright;
+        double detsum;
+
+        if (detleft > 0.0)
+        {
+            if (detright <= 0.0)
+                return (det > 0.0) - (det < 0.0);
+            detsum = detleft + detright;
+        }
+        else if (detleft < 0.0)
+        {
+            if (detright >= 0.0)
+                return (det > 0.0) - (det < 0.0);
+            detsum = -detleft - detright;
+        }
+        else
+            return (det > 0.0) - (det < 0.0);
+
+        double errbound = CCW_ERRBOUND_A * detsum;
+        if (det >= errbound || -det >= errbound)
+            return (det > 0.0) - (det < 0.0);
+
+        return orient2d_exact(ax, ay, bx, by, cx, cy);
+    }
+
+}
@@ -0,0 +1,139 @@
+#include "reorder.h"
+#include "hilbert.h"
+#include <algorithm>
+#include <cstdlib>
+#include <numeric>
+
+std::vector<int> hilbert_order(const std::vector<Pt> &nodes)
+{
+    std::vector<int> order(nodes.size());
+    std::iota(order.begin(), order.end(), 0);
+    if (nodes.empty())
+        return order;
+
+    double x0 = nodes[0].x, y0 = nodes[0].y, x1 = x0, y1 = y0;
+    for (const auto &p : nodes)
+    {
+        x0 = std::min(x0, p.x);
+        y0 = std::min(y0, p.y);
+        x1 = std::max(x1, p.x);
+        y1 = std::max(y1, p.y);
+    }
+    std::vector<uint32_t> h(nodes.size());
+    for (size_t i = 0; i < nodes.size(); ++i)
+        h[i] = hilbert_index(nodes[i].x, nodes[i].y, x0, y0, x1 - x0, y1 - y0);
+    std::sort(order.begin(), order.end(), [&](int a, int b)
+              { return h[a] != h[b] ? h[a] < h[b] : a < b; });
+    return order;
+}
+
+std::vector<int> rcm_order(int n, const std::vector<std::pair<int, int>> &edges, const std::vector<int> &seed)
+{
+    // смежность в CSR; соседи по (степень, место в seed)
+    std::vector<int> rank(n), start(n + 1, 0), adj(2 * edges.size());
+    for (int k = 0; k < n; ++k)
+        rank[seed[k]] = k;
+    for (auto [u, v] : edges)
+    {
+        start[u + 1]++;
+        start[v + 1]++;
+    }
+    for (int i = 0; i < n; ++i)
+        start[i + 1] += start[i];
+    std::vector<int> fill(start.begin(), start.end() - 1);
+    for (auto [u, v] : edges)
+    {
+        adj[fill[u]++] = v;
+        adj[fill[v]++] = u;
+    }
+    auto degree = [&](int i)
+    { return start[i + 1] - start[i]; };
+    auto before = [&](int a, int b)
+    { return degree(a) != degree(b) ? degree(a) < degree(b) : rank[a] < rank[b]; };
+    for (int i = 0; i < n; ++i)
+        std::sort(adj.begin() + start[i], adj.begin() + start[i + 1], before);
+
+    // обход в ширину от s; в out - порядок обхода, dist - номер уровня (seen отличает обходы)
+    std::vector<int> seen(n, -1), dist(n, 0);
+    int pass = 0;
+    auto bfs = [&](int s, std::vector<int> &out)
+    {
+        out.clear();
+        out.push_back(s);
+        seen[s] = pass;
+        dist[s] = 0;
+        for (size_t q = 0; q < out.size(); ++q)
+            for (int k = start[out[q]]; k < start[out[q] + 1]; ++k)
+                if (seen[adj[k]] != pass)
+                {
+                    seen[adj[k]] = pass;
+                    dist[adj[k]] = dist[out[q]] + 1;
+                    out.push_back(adj[k]);
+                }
+        ++pass;
+    };
+
+    std::vector<int> order, comp;
+    order.reserve(n);
+    std::vector<char> placed(n, 0);
+    for (int s : seed)
+    {
+        if (placed[s])
+            continue;
+        // псевдопериферийный узел: из последнего уровня обхода от s - узел наименьшей степени
+        bfs(s, comp);
+        int far = comp.back();
+        for (auto it = comp.rbegin(); it != comp.rend() && dist[*it] == dist[comp.back()]; ++it)
+            if (before(*it, far))
+                far = *it;
+        bfs(far, comp);
+        for (int i : comp)
+            placed[i] = 1;
+        order.insert(order.end(), comp.begin(), comp.end());
+    }
+    std::reverse(order.begin(), order.end());
+    return order;
+}
+
+void renumber_trench(TrenchGraph &g, const std::vector<int> &order)
+{
+    std::vector<int> id(order.size());
+    std::vector<Pt> nodes(order.size());
+    for (size_t k = 0; k < order.size(); ++k)
+    {
+        id[order[k]] = (int)k;
+        nodes[k] = g.nodes[order[k]];
+    }
+    for (auto &[u, v] : g.edges)
+    {
+        u = id[u];
+        v = id[v];
+        if (u > v)
+            std::swap(u, v);
+    }
+    std::sort(g.edges.begin(), g.edges.end());
+    g.nodes = std::move(nodes);
+}
+
+static double mean_span(const std::vector<std::pair<int, int>> &edges)
+{
+    double s = 0.0;
+    for (auto [u, v] : edges)
+        s += std::abs(u - v);
+    return edges.empty() ? 0.0 : s / edges.size();
+}
+
+NodeOrderStats reorder_trench_nodes(TrenchGraph &g, const std::string &mode)
+{
+    NodeOrderStats st;
+    if (mode != "hilbert" && mode != "rcm")
+        return st;
+    st.nodes = g.nodes.size();
+    st.span_before = mean_span(g.edges);
+    std::vector<int> order = hilbert_order(g.nodes);
+    if (mode == "rcm")
+        order = rcm_order((int)g.nodes.size(), g.edges, order);
+    renumber_trench(g, order);
+    st.span_after = mean_span(g.edges);
+    return st;
+}
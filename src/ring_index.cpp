@@ -0,0 +1,110 @@
+#include "roads.h"
+#include <algorithm>
+
+static const int LEAF_SIZE = 8;
+
+struct EdgeBox
+{
+    double x0, y0, x1, y1;
+    double cx, cy;
+};
+
+static int build_node(RingIndex &idx, std::vector<EdgeBox> &boxes, int lo, int hi)
+{
+    int id = (int)idx.nodes.size();
+    idx.nodes.push_back({1e300, 1e300, -1e300, -1e300, lo, hi - lo});
+
+    RingIndex::Node n = idx.nodes[id];
+    double cx0 = 1e300, cy0 = 1e300, cx1 = -1e300, cy1 = -1e300;
+    for (int i = lo; i < hi; ++i)
+    {
+        const EdgeBox &b = boxes[idx.edges[i]];
+        n.x0 = std::min(n.x0, b.x0);
+        n.y0 = std::min(n.y0, b.y0);
+        n.x1 = std::max(n.x1, b.x1);
+        n.y1 = std::max(n.y1, b.y1);
+        cx0 = std::min(cx0, b.cx);
+        cy0 = std::min(cy0, b.cy);
+        cx1 = std::max(cx1, b.cx);
+        cy1 = std::max(cy1, b.cy);
+    }
+
+    if (hi - lo > LEAF_SIZE)
+    {
+        // деление пополам по медиане центров вдоль более длинной оси
+        int mid = (lo + hi) / 2;
+        bool by_x = (cx1 - cx0) >= (cy1 - cy0);
+        std::nth_element(idx.edges.begin() + lo, idx.edges.begin() + mid, idx.edges.begin() + hi,
+                         [&](int a, int b)
+                         { return by_x ? boxes[a].cx < boxes[b].cx : boxes[a].cy < boxes[b].cy; });
+        n.count = 0;
+        build_node(idx, boxes, lo, mid);
+        n.first = build_node(idx, boxes, mid, hi);
+    }
+    idx.nodes[id] = n;
+    return id;
+}
+
+void RingIndex::build(const std::vector<Pt> &ring)
+{
+    nodes.clear();
+    edges.clear();
+    int n = (int)ring.size();
+    if (n < 2)
+        return;
+
+    std::vector<EdgeBox> boxes(n);
+    for (int k = 0; k < n; ++k)
+    {
+        Pt a = ring[k], b = ring[(k + n - 1) % n];
+        boxes[k] = {std::min(a.x, b.x), std::min(a.y, b.y), std::max(a.x, b.x), std::max(a.y, b.y),
+                    (a.x + b.x) / 2.0, (a.y + b.y) / 2.0};
+    }
+    edges.resize(n);
+    for (int k = 0; k < n; ++k)
+        edges[k] = k;
+    nodes.reserve(2 * (n / LEAF_SIZE + 1));
+    build_node(*this, boxes, 0, n);
+}
+
+void build_ring_indexes(Roads &roads, size_t min_vertices)
+{
+    for (auto &poly : roads.polygons)
+    {
+        if (poly.ring.size() >= min_vertices)
+            poly.index.build(poly.ring);
+        else
+            poly.index = RingIndex{};
+    }
+}
+
+bool polygon_contains(const Polygon &poly, Pt p)
+{
+    if (!poly.mask.empty())
+    {
+        uint8_t st = poly.mask.state(p);
+        if (st != OccupancyMask::BOUNDARY)
+            return st == OccupancyMask::INSIDE;
+    }
+    if (poly.index.empty())
+        return point_in_polygon(p, poly.ring);
+
+    // те же правила, что в point_in_polygon, но только по рёбрам, задевающим луч вправо от p
+    const auto &R = poly.ring;
+    int n = (int)R.size();
+    const double e = ON_SEGMENT_TOL;
+    bool c = false;
+    bool on_edge = poly.index.query(p.x - e, p.y - e, 1e300, p.y + e, [&](int k)
+                                    {
+        Pt a = R[k], b = R[(k + n - 1) % n];
+        if (on_segment(p, {a, b}))
+            return true;
+        if ((a.y > p.y) != (b.y > p.y))
+        {
+            int o = orient(a, b, p);
+            if (b.y > a.y ? o > 0 : o < 0)
+                c = !c;
+        }
+        return false; });
+    return on_edge ? false : c;
+}
@@ -0,0 +1,196 @@
+#include "route.h"
+#include "components.h"
+#include <queue>
+#include <limits>
+#include <algorithm>
+
+RouteGraph build_route_graph(const TrenchGraph &trench, const HDDGraph &hdd)
+{
+    RouteGraph g;
+    int nT = (int)trench.nodes.size();
+    int nH = (int)hdd.nodes.size();
+    g.n_trench = nT;
+    g.points = trench.nodes;
+    g.points.insert(g.points.end(), hdd.nodes.begin(), hdd.nodes.end());
+
+    struct Arc
+    {
+        int u, v;
+        char kind;
+    };
+    std::vector<Arc> arcs;
+    arcs.reserve(2 * (trench.edges.size() + hdd.edges.size() + hdd.trench_to_hdd.size()));
+    for (auto [u, v] : trench.edges)
+    {
+        arcs.push_back({u, v, EDGE_TRENCH});
+        arcs.push_back({v, u, EDGE_TRENCH});
+    }
+    for (auto [u, v] : hdd.edges)
+    {
+        arcs.push_back({nT + u, nT + v, EDGE_HDD});
+        arcs.push_back({nT + v, nT + u, EDGE_HDD});
+    }
+    for (int i = 0; i < (int)hdd.trench_to_hdd.size() && i < nT; ++i)
+    {
+        int h = hdd.trench_to_hdd[i];
+        if (h < 0 || h >= nH)
+            continue;
+        arcs.push_back({i, nT + h, EDGE_TRANSITION});
+        arcs.push_back({nT + h, i, EDGE_TRANSITION});
+    }
+
+    int S = nT + nH;
+    g.offset.assign(S + 1, 0);
+    for (const auto &a : arcs)
+        g.offset[a.u + 1]++;
+    for (int s = 0; s < S; ++s)
+        g.offset[s + 1] += g.offset[s];
+    g.target.resize(arcs.size());
+    g.length.resize(arcs.size());
+    g.kind.resize(arcs.size());
+    std::vector<int> pos(g.offset.begin(), g.offset.end() - 1);
+    for (const auto &a : arcs)
+    {
+        int k = pos[a.u]++;
+        g.target[k] = a.v;
+        g.length[k] = a.kind == EDGE_TRANSITION ? 0.0 : norm(g.points[a.v] - g.points[a.u]);
+        g.kind[k] = a.kind;
+    }
+
+    std::vector<std::pair<int, int>> links;
+    links.reserve(arcs.size() / 2);
+    for (const auto &a : arcs)
+        if (a.u < a.v)
+            links.emplace_back(a.u, a.v);
+    g.component = connected_components(g.points, links).of;
+    return g;
+}
+
+int nearest_node(const std::vector<Pt> &nodes, Pt p)
+{
+    int best = -1;
+    double bd = std::numeric_limits<double>::infinity();
+    for (int i = 0; i < (int)nodes.size(); ++i)
+    {
+        double d = norm2(nodes[i] - p);
+        if (d < bd)
+        {
+            bd = d;
+            best = i;
+        }
+    }
+    return best;
+}
+
+// Дейкстра по двухслойному графу; expand(s, emit) перечисляет дуги состояния s
+// вызовами emit(t, length, kind). Длины дуг перехода - 0, их цена - transition_per_edge.
+template <class Expand>
+static Route dijkstra(int S, int from, int to, const Config &cfg, Expand &&expand)
+{
+    Route r;
+    const double INF = std::numeric_limits<double>::infinity();
+    std::vector<double> dist(S, INF), prev_len(S, 0.0);
+    std::vector<int> prev(S, -1);
+    std::vector<char> prev_kind(S, EDGE_TRENCH);
+    using QE = std::pair<double, int>;
+    std::priority_queue<QE, std::vector<QE>, std::greater<QE>> pq;
+    dist[from] = 0.0;
+    pq.push({0.0, from});
+
+    const double price[3] = {cfg.trench_per_m, cfg.hdd_per_m, 0.0};
+    while (!pq.empty())
+    {
+        auto [d, s] = pq.top();
+        pq.pop();
+        if (d > dist[s])
+            continue;
+        if (s == to)
+            break;
+        expand(s, [&](int t, double len, char kind)
+               {
+            double w = kind == EDGE_TRANSITION ? cfg.transition_per_edge : len * price[(int)kind];
+            if (d + w < dist[t])
+            {
+                dist[t] = d + w;
+                prev[t] = s;
+                prev_len[t] = len;
+                prev_kind[t] = kind;
+                pq.push({dist[t], t});
+            } });
+    }
+    if (dist[to] == INF)
+        return r;
+
+    r.found = true;
+    r.cost = dist[to];
+    for (int s = to; s != -1; s = prev[s])
+    {
+        r.states.push_back(s);
+        if (prev[s] < 0)
+            continue;
+        if (prev_kind[s] == EDGE_TRENCH)
+            r.trench_length += prev_len[s];
+        else if (prev_kind[s] == EDGE_HDD)
+            r.hdd_length += prev_len[s];
+        else
+            r.transitions++;
+    }
+    std::reverse(r.states.begin(), r.states.end());
+    return r;
+}
+
+Route shortest_route(const RouteGraph &g, const Config &cfg, int from, int to)
+{
+    int S = (int)g.offset.size() - 1;
+    if (from < 0 || to < 0 || from >= g.n_trench || to >= g.n_trench)
+        return {};
+    if (!g.component.empty() && g.component[from] != g.component[to])
+    {
+        Route r;
+        r.disconnected = true;
+        return r;
+    }
+    return dijkstra(S, from, to, cfg, [&](int s, auto &&emit)
+                    {
+        for (int k = g.offset[s]; k < g.offset[s + 1]; ++k)
+            emit(g.target[k], g.length[k], g.kind[k]); });
+}
+
+LazyRouteGraph::LazyRouteGraph(const Roads &roads, const TrenchGraph &trench, const HDDParams &prm)
+    : n_trench((int)trench.nodes.size()), nodes(trench.nodes), hdd(roads, trench.nodes, prm)
+{
+    offset.assign(n_trench + 1, 0);
+    for (auto [u, v] : trench.edges)
+    {
+        offset[u + 1]++;
+        offset[v + 1]++;
+    }
+    for (int s = 0; s < n_trench; ++s)
+        offset[s + 1] += offset[s];
+    target.resize(offset.back());
+    std::vector<int> pos(offset.begin(), offset.end() - 1);
+    for (auto [u, v] : trench.edges)
+    {
+        target[pos[u]++] = v;
+        target[pos[v]++] = u;
+    }
+}
+
+Route shortest_route(LazyRouteGraph &g, const Config &cfg, int from, int to)
+{
+    int nT = g.n_trench;
+    if (from < 0 || to < 0 || from >= nT || to >= nT)
+        return {};
+    return dijkstra(2 * nT, from, to, cfg, [&](int s, auto &&emit)
+                    {
+        int i = s < nT ? s : s - nT;
+        char kind = s < nT ? EDGE_TRENCH : EDGE_HDD;
+        int base = s < nT ? 0 : nT;
+        // слой ГНБ содержит рёбра траншей и поперечные рёбра, как в build_hdd_from_trench
+        for (int k = g.offset[i]; k < g.offset[i + 1]; ++k)
+            emit(base + g.target[k], norm(g.nodes[g.target[k]] - g.nodes[i]), kind);
+        if (s >= nT)
+            for (int j : g.hdd.cross_neighbours(i))
+                emit(nT + j, norm(g.nodes[j] - g.nodes[i]), EDGE_HDD);
+        emit(s < nT ? nT + i : i, 0.0, EDGE_TRANSITION); });
+}
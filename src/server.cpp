@@ -0,0 +1,314 @@
+#include "server.h"
+#include "io.h"
+#include "export.h"
+#include "json_esc.h"
+#include <chrono>
+#include <sstream>
+#include <iomanip>
+#include <iostream>
+#include <new>
+#include <stdexcept>
+#include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <cstring>
+#include <cerrno>
+#include <csignal>
+#define SERVER_HAS_UNIX_SOCKET 1
+#endif
+
+namespace server
+{
+
+    static std::string error(const std::string &msg)
+    {
+        return "{\"ok\":false,\"error\":" + json_str(msg) + "}";
+    }
+
+    static std::string handle_build(Session &session, const Config &cfg, const std::string &line)
+    {
+        bool reused_trench = false, reused_hdd = false;
+        const auto &trench = session.trench(cfg, &reused_trench);
+        const auto &hdd = session.hdd(cfg, &reused_hdd);
+
+        std::string out;
+        if (io::extract_string(line, "out", out))
+        {
+            write_graph(out, cfg, trench, hdd);
+        }
+
+        std::ostringstream o;
+        o << "{\"ok\":true,\"trench_nodes\":" << trench.nodes.size()
+          << ",\"trench_edges\":" << trench.edges.size()
+          << ",\"hdd_edges\":" << hdd.edges.size()
+          << ",\"reused_trench\":" << (reused_trench ? "true" : "false")
+          << ",\"reused_hdd\":" << (reused_hdd ? "true" : "false");
+        if (!out.empty())
+            o << ",\"written\":" << json_str(out);
+        o << "}";
+        return o.str();
+    }
+
+    static std::string handle_route(Session &session, const Config &cfg, const std::string &line)
+    {
+        std::vector<double> from, to;
+        if (!io::extract_numbers(line, "from", from) || from.size() != 2 ||
+            !io::extract_numbers(line, "to", to) || to.size() != 2)
+            return error("route needs \"from\":[x,y] and \"to\":[x,y]");
+
+        const auto &trench = session.trench(cfg);
+        int s = nearest_node(trench.nodes, {from[0], from[1]});
+        int t = nearest_node(trench.nodes, {to[0], to[1]});
+        bool lazy = cfg.hdd_mode == "lazy";
+
+        Route r;
+        int n_trench = (int)trench.nodes.size();
+        std::vector<Pt> path;
+        size_t expanded = 0, found = 0;
+        if (lazy)
+        {
+            auto &lg = session.lazy_route_graph(cfg);
+            r = shortest_route(lg, cfg, s, t);
+            for (int st : r.states)
+                path.push_back(lg.point(st));
+            expanded = lg.hdd.expanded();
+            found = lg.hdd.edges_found();
+        }
+        else
+        {
+            const auto &rg = session.route_graph(cfg);
+            r = shortest_route(rg, cfg, s, t);
+            for (int st : r.states)
+                path.push_back(rg.points[st]);
+        }
+
+        std::ostringstream o;
+        o.setf(std::ios::fixed);
+        o << std::setprecision(6);
+        o << "{\"ok\":true,\"found\":" << (r.found ? "true" : "false")
+          << ",\"from_node\":" << s << ",\"to_node\":" << t;
+        if (lazy)
+            o << ",\"hdd_nodes_expanded\":" << expanded << ",\"hdd_edges_found\":" << found;
+        if (r.disconnected)
+            o << ",\"disconnected\":true";
+        if (r.found)
+        {
+            o << ",\"cost\":" << r.cost
+              << ",\"trench_length\":" << r.trench_length
+              << ",\"hdd_length\":" << r.hdd_length
+              << ",\"transitions\":" << r.transitions
+              << ",\"path\":[";
+            for (size_t i = 0; i < r.states.size(); ++i)
+            {
+                const Pt &p = path[i];
+                o << (i ? "," : "") << "[" << p.x << "," << p.y << ","
+                  << (r.states[i] < n_trench ? 0 : 1) << "]";
+            }
+            o << "]";
+        }
+        o << "}";
+        return o.str();
+    }
+
+    static std::string handle_export(Session &session, const Config &cfg, const std::string &line)
+    {
+        std::vector<double> bbox;
+        std::string out;
+        if (!io::extract_numbers(line, "bbox", bbox) || bbox.size() != 4)
+            return error("export needs \"bbox\":[x0,y0,x1,y1]");
+        if (!io::extract_string(line, "out", out))
+            return error("export needs \"out\"");
+
+        Region region{bbox[0], bbox[1], bbox[2], bbox[3]};
+        const auto &trench = session.trench(cfg);
+        const auto &hdd = session.hdd(cfg);
+        write_graph(out, cfg, trench, hdd, &region);
+        return "{\"ok\":true,\"written\":" + json_str(out) + "}";
+    }
+
+    static std::string handle_request(Session &session, const Config &base, const std::string &line, bool &quit)
+    {
+        std::string cmd;
+        if (!io::extract_string(line, "cmd", cmd))
+            return error("missing \"cmd\"");
+
+        Config cfg = base;
+        io::parse_config_text(line, cfg);
+
+        // дороги и препятствия разобраны при запуске: эти поля запроса на них уже не влияют,
+        // поэтому остаются как при запуске и перечисляются в ответе в "ignored"
+        std::vector<std::string> ignored;
+        double v;
+        if (io::extract_double(line, "simplify_tolerance", v))
+        {
+            cfg.simplify_tolerance = base.simplify_tolerance;
+            ignored.push_back("simplify_tolerance");
+        }
+        if (io::extract_double(line, "mask_cell", v))
+        {
+            cfg.mask_cell = base.mask_cell;
+            ignored.push_back("mask_cell");
+        }
+        if (line.find("\"obstacles\"") != std::string::npos)
+            ignored.push_back("obstacles");
+
+        auto t0 = std::chrono::steady_clock::now();
+        std::string resp;
+        if (cmd == "build")
+            resp = handle_build(session, cfg, line);
+        else if (cmd == "route")
+            resp = handle_route(session, cfg, line);
+        else if (cmd == "export")
+            resp = handle_export(session, cfg, line);
+        else if (cmd == "stats")
+            resp = "{\"ok\":true,\"polygons\":" + std::to_string(session.roads.polygons.size()) +
+                   ",\"cached_trench\":" + std::to_string(session.cached_trench()) +
+                   ",\"cached_hdd\":" + std::to_string(session.cached_hdd()) + "}";
+        else if (cmd == "clear")
+        {
+            session.clear();
+            resp = "{\"ok\":true}";
+        }
+        else if (cmd == "quit")
+        {
+            quit = true;
+            resp = "{\"ok\":true}";
+        }
+        else
+            return error("unknown cmd: " + cmd);
+
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+        // время выполнения добавляем последним полем
+        resp.pop_back();
+        std::ostringstream o;
+        o << resp;
+        if (!ignored.empty())
+        {
+            o << ",\"ignored\":[";
+            for (size_t i = 0; i < ignored.size(); ++i)
+                o << (i ? "," : "") << json_str(ignored[i]);
+            o << "]";
+        }
+        o << ",\"ms\":" << std::fixed << std::setprecision(3) << ms << "}";
+        return o.str();
+    }
+
+    // Исключение одного запроса (число вне диапазона double, нехватка памяти, ...) не должно
+    // останавливать сервер: оно становится ответом с ошибкой.
+    std::string handle(Session &session, const Config &base, const std::string &line, bool &quit)
+    {
+        try
+        {
+            return handle_request(session, base, line, quit);
+        }
+        catch (const std::out_of_range &)
+        {
+            return error("number out of range");
+        }
+        catch (const std::bad_alloc &)
+        {
+            return error("out of memory");
+        }
+        catch (const std::exception &e)
+        {
+            return error(std::string("request failed: ") + e.what());
+        }
+    }
+
+    int run_stream(Session &session, const Config &base, std::istream &in, std::ostream &out)
+    {
+        std::string line;
+        bool quit = false;
+        while (!quit && std::getline(in, line))
+        {
+            if (line.find_first_not_of(" \t\r") == std::string::npos)
+                continue;
+            out << handle(session, base, line, quit) << "\n";
+            out.flush();
+        }
+        return 0;
+    }
+
+    int run_socket(Session &session, const Config &base, const std::string &path)
+    {
+#ifdef SERVER_HAS_UNIX_SOCKET
+        sockaddr_un addr{};
+        if (path.size() >= sizeof(addr.sun_path))
+        {
+            std::cerr << "Socket path too long: " << path << "\n";
+            return 3;
+        }
+        int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd < 0)
+        {
+            std::cerr << "socket() failed: " << std::strerror(errno) << "\n";
+            return 3;
+        }
+        addr.sun_family = AF_UNIX;
+        std::strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+        unlink(path.c_str());
+        if (bind(fd, (sockaddr *)&addr, sizeof(addr)) < 0 || listen(fd, 8) < 0)
+        {
+            std::cerr << "Can't listen on " << path << ": " << std::strerror(errno) << "\n";
+            close(fd);
+            return 3;
+        }
+        std::cerr << "Listening on " << path << "\n";
+
+        // клиент, закрывший соединение до ответа, - ошибка EPIPE у write, а не SIGPIPE на весь процесс
+        std::signal(SIGPIPE, SIG_IGN);
+
+        bool quit = false;
+        while (!quit)
+        {
+            int c = accept(fd, nullptr, nullptr);
+            if (c < 0)
+                continue;
+            std::string buf;
+            char chunk[4096];
+            ssize_t n;
+            bool alive = true;
+            while (!quit && alive && (n = read(c, chunk, sizeof(chunk))) > 0)
+            {
+                buf.append(chunk, n);
+                size_t nl;
+                while (!quit && alive && (nl = buf.find('\n')) != std::string::npos)
+                {
+                    std::string line = buf.substr(0, nl);
+                    buf.erase(0, nl + 1);
+                    if (line.find_first_not_of(" \t\r") == std::string::npos)
+                        continue;
+                    std::string resp = handle(session, base, line, quit) + "\n";
+                    for (size_t off = 0; off < resp.size();)
+                    {
+                        ssize_t w = write(c, resp.data() + off, resp.size() - off);
+                        if (w < 0 && errno == EINTR)
+                            continue;
+                        if (w <= 0)
+                        {
+                            // клиент ушёл: закрываем только это соединение
+                            std::cerr << "Client write failed: " << std::strerror(errno) << "\n";
+                            alive = false;
+                            break;
+                        }
+                        off += w;
+                    }
+                }
+            }
+            close(c);
+        }
+        close(fd);
+        unlink(path.c_str());
+        return 0;
+#else
+        (void)session;
+        (void)base;
+        std::cerr << "Unix sockets are not supported on this platform: " << path << "\n";
+        return 3;
+#endif
+    }
+
+}
@@ -0,0 +1,156 @@
+#include "session.h"
+#include "io.h"
+
+bool Session::load(const std::string &roads_path, const Config &cfg, const std::vector<std::string> &obstacle_paths)
+{
+    const double simplify_tolerance = cfg.simplify_tolerance;
+    roads = Roads{};
+    clear();
+    roads_from_disk = false;
+    simplified = SimplifyStats{};
+    reordered = NodeOrderStats{};
+
+    std::string text = io::read_file(roads_path);
+    if (text.empty())
+        return false;
+    roads_hash = StageCache::hash(text, StageCache::hash(std::string("roads")));
+    if (simplify_tolerance > 0.0)
+        roads_hash = StageCache::hash(simplify_tolerance, roads_hash);
+
+    if (disk.load(roads_hash, roads))
+        roads_from_disk = true;
+    else
+    {
+        if (!io::parse_roads_geojson(text, roads))
+            return false;
+        if (simplify_tolerance > 0.0)
+            simplified = simplify_roads(roads, simplify_tolerance);
+        disk.store(roads_hash, roads);
+    }
+    build_ring_indexes(roads);
+    build_occupancy_masks(roads, cfg.mask_cell);
+
+    for (const auto &path : obstacle_paths)
+    {
+        if (!io::load_obstacles_geojson(path, roads.obstacles))
+            return false;
+        roads_hash = StageCache::hash(io::read_file(path), roads_hash);
+    }
+    roads.obstacles.build_index(cfg.mask_cell);
+    return true;
+}
+
+uint64_t Session::trench_hash(const Config &cfg) const
+{
+    uint64_t h = StageCache::hash(cfg.trench_mode, roads_hash);
+    h = StageCache::hash(cfg.boundary_step, h);
+    if (cfg.node_order != "input")
+        h = StageCache::hash(cfg.node_order, h);
+    return h;
+}
+
+uint64_t Session::hdd_hash(const Config &cfg) const
+{
+    uint64_t h = trench_hash(cfg);
+    h = StageCache::hash(cfg.hdd_min_length, h);
+    h = StageCache::hash(cfg.hdd_max_length, h);
+    return StageCache::hash(cfg.hdd_alpha_deg, h);
+}
+
+void Session::clear()
+{
+    lazy_cache.clear();
+    trench_cache.clear();
+    hdd_cache.clear();
+    route_cache.clear();
+}
+
+Session::TrenchKey Session::trench_key(const Config &cfg)
+{
+    return {cfg.trench_mode, cfg.boundary_step, cfg.node_order};
+}
+
+Session::HDDKey Session::hdd_key(const Config &cfg)
+{
+    return {cfg.trench_mode, cfg.boundary_step, cfg.node_order, cfg.hdd_min_length, cfg.hdd_max_length, cfg.hdd_alpha_deg};
+}
+
+const TrenchGraph &Session::trench(const Config &cfg, bool *reused)
+{
+    auto key = trench_key(cfg);
+    if (auto *g = trench_cache.find(key))
+    {
+        if (reused)
+            *reused = true;
+        return *g;
+    }
+    if (reused)
+        *reused = false;
+
+    TrenchGraph g;
+    uint64_t h = trench_hash(cfg);
+    if (disk.load(h, g))
+    {
+        if (reused)
+            *reused = true;
+    }
+    else
+    {
+        g = cfg.trench_mode == "union" ? build_trench_union(roads, cfg.boundary_step)
+                                       : build_trench_strict(roads, cfg.boundary_step);
+        reordered = reorder_trench_nodes(g, cfg.node_order);
+        disk.store(h, g);
+    }
+    // ленивые графы держат ссылку на траншеи - уходят вместе с ними
+    return trench_cache.insert(key, std::move(g), max_cached, [&](const TrenchKey &old)
+                               { lazy_cache.erase_if([&](const HDDKey &k)
+                                                     { return std::get<0>(k) == std::get<0>(old) &&
+                                                              std::get<1>(k) == std::get<1>(old) &&
+                                                              std::get<2>(k) == std::get<2>(old); }); });
+}
+
+const HDDGraph &Session::hdd(const Config &cfg, bool *reused)
+{
+    auto key = hdd_key(cfg);
+    if (auto *g = hdd_cache.find(key))
+    {
+        if (reused)
+            *reused = true;
+        return *g;
+    }
+    if (reused)
+        *reused = false;
+
+    HDDGraph g;
+    uint64_t h = hdd_hash(cfg);
+    if (disk.load(h, g))
+    {
+        if (reused)
+            *reused = true;
+    }
+    else
+    {
+        const auto &t = trench(cfg);
+        g = build_hdd_from_trench(roads, t.nodes, t.edges, make_hdd_params(cfg));
+        disk.store(h, g);
+    }
+    return hdd_cache.insert(key, std::move(g), max_cached, [](const HDDKey &) {});
+}
+
+const RouteGraph &Session::route_graph(const Config &cfg)
+{
+    auto key = hdd_key(cfg);
+    if (auto *g = route_cache.find(key))
+        return *g;
+    auto g = build_route_graph(trench(cfg), hdd(cfg));
+    return route_cache.insert(key, std::move(g), max_cached, [](const HDDKey &) {});
+}
+
+LazyRouteGraph &Session::lazy_route_graph(const Config &cfg)
+{
+    auto key = hdd_key(cfg);
+    if (auto *g = lazy_cache.find(key))
+        return **g;
+    auto g = std::make_unique<LazyRouteGraph>(roads, trench(cfg), make_hdd_params(cfg));
+    return *lazy_cache.insert(key, std::move(g), max_cached, [](const HDDKey &) {});
+}
@@ -0,0 +1,155 @@
+#include "simplify.h"
+#include "parallel.h"
+#include <cmath>
+
+// Отмечает keep для вершин pts[lo..hi], которые нужно оставить, чтобы отклонение не превышало tol
+static void douglas_peucker(const std::vector<Pt> &pts, int lo, int hi, double tol, std::vector<char> &keep)
+{
+    std::vector<std::pair<int, int>> stack{{lo, hi}};
+    while (!stack.empty())
+    {
+        auto [a, b] = stack.back();
+        stack.pop_back();
+        if (b - a < 2)
+            continue;
+        Seg s{pts[a], pts[b % pts.size()]};
+        int far = -1;
+        double best = tol;
+        for (int i = a + 1; i < b; ++i)
+        {
+            double d = dist_point_seg(pts[i], s);
+            if (d > best)
+            {
+                best = d;
+                far = i;
+            }
+        }
+        if (far < 0)
+            continue;
+        keep[far] = 1;
+        stack.push_back({a, far});
+        stack.push_back({far, b});
+    }
+}
+
+static double signed_area(const std::vector<Pt> &ring)
+{
+    double a = 0.0;
+    for (size_t k = 1; k < ring.size(); ++k)
+        a += cross(ring[k - 1], ring[k]);
+    return a / 2;
+}
+
+// Замкнутое кольцо без самопересечений: несоседние рёбра не пересекаются и не касаются
+static bool ring_is_simple(const std::vector<Pt> &ring)
+{
+    int n = (int)ring.size() - 1; // рёбра 1..n, ребро k - {ring[k-1], ring[k]}
+    RingIndex idx;
+    idx.build(ring);
+    for (int k = 1; k <= n; ++k)
+    {
+        Seg s{ring[k - 1], ring[k]};
+        bool bad = idx.query(std::min(s.a.x, s.b.x), std::min(s.a.y, s.b.y),
+                             std::max(s.a.x, s.b.x), std::max(s.a.y, s.b.y), [&](int m)
+                             {
+            if (m <= k + 1 || m < 1 || (k == 1 && m == n))
+                return false; // каждая пара один раз, соседние рёбра делят вершину
+            return seg_intersect(s, {ring[m - 1], ring[m]}); });
+        if (bad)
+            return false;
+    }
+    return true;
+}
+
+bool simplify_ring(std::vector<Pt> &ring, double tolerance, double *deviation, bool *rejected)
+{
+    if (deviation)
+        *deviation = 0.0;
+    if (rejected)
+        *rejected = false;
+    // кольцо замкнуто: последняя вершина повторяет первую
+    int n = (int)ring.size() - 1;
+    if (n < 4 || tolerance <= 0.0)
+        return false;
+    std::vector<Pt> pts(ring.begin(), ring.begin() + n);
+
+    // опорные вершины - первая и самая далёкая от неё, кольцо делится на две цепочки
+    int far = 0;
+    for (int i = 1; i < n; ++i)
+        if (norm2(pts[i] - pts[0]) > norm2(pts[far] - pts[0]))
+            far = i;
+    if (far == 0)
+        return false;
+
+    const double area = signed_area(ring);
+    for (double tol = tolerance; tol >= tolerance / 8; tol /= 2)
+    {
+        std::vector<char> keep(n, 0);
+        keep[0] = keep[far] = 1;
+        douglas_peucker(pts, 0, far, tol, keep);
+        douglas_peucker(pts, far, n, tol, keep); // индекс n - снова вершина 0
+
+        std::vector<Pt> out;
+        std::vector<int> kept;
+        for (int i = 0; i < n; ++i)
+            if (keep[i])
+            {
+                out.push_back(pts[i]);
+                kept.push_back(i);
+            }
+        if (out.size() == (size_t)n)
+            return false; // упрощать нечего
+        if (rejected)
+            *rejected = true;
+        if (out.size() < 3)
+            continue;
+        out.push_back(out.front());
+        double a = signed_area(out);
+        if (a * area <= 0.0 || !ring_is_simple(out))
+            continue;
+
+        if (deviation)
+        {
+            double dev = 0.0;
+            for (size_t j = 0; j < kept.size(); ++j)
+            {
+                int from = kept[j], to = j + 1 < kept.size() ? kept[j + 1] : n;
+                Seg s{pts[from], pts[to % n]};
+                for (int i = from + 1; i < to; ++i)
+                    dev = std::max(dev, dist_point_seg(pts[i], s));
+            }
+            *deviation = dev;
+        }
+        ring = std::move(out);
+        if (rejected)
+            *rejected = false;
+        return true;
+    }
+    return false;
+}
+
+SimplifyStats simplify_roads(Roads &roads, double tolerance, int threads)
+{
+    SimplifyStats st;
+    int P = (int)roads.polygons.size();
+    std::vector<double> dev(P, 0.0);
+    std::vector<char> kept(P, 0);
+    for (const auto &p : roads.polygons)
+        st.vertices_before += p.ring.size();
+
+    parallel_for(P, [&](int i)
+                 {
+        auto &poly = roads.polygons[i];
+        bool rejected = false;
+        simplify_ring(poly.ring, tolerance, &dev[i], &rejected);
+        kept[i] = rejected;
+        poly.index = RingIndex{}; }, threads);
+
+    for (int i = 0; i < P; ++i)
+    {
+        st.vertices_after += roads.polygons[i].ring.size();
+        st.max_deviation = std::max(st.max_deviation, dev[i]);
+        st.rings_kept += kept[i];
+    }
+    return st;
+}
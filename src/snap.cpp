@@ -0,0 +1,428 @@
+#include "snap.h"
+#include "graph.h"
+#include "io.h"
+#include "geojson_writer.h"
+#include "parallel.h"
+#include "box_grid.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <numeric>
+#include <queue>
+
+KdTree::KdTree(const std::vector<Pt> &pts) : pts_(pts), idx_(pts.size())
+{
+    std::iota(idx_.begin(), idx_.end(), 0);
+    build(0, (int)idx_.size(), 0);
+}
+
+// Медиана отрезка [lo, hi) по оси depth % 2 - в середину, меньшие слева, большие справа
+void KdTree::build(int lo, int hi, int depth)
+{
+    if (hi - lo <= 1)
+        return;
+    int mid = (lo + hi) / 2;
+    const bool by_x = depth % 2 == 0;
+    std::nth_element(idx_.begin() + lo, idx_.begin() + mid, idx_.begin() + hi, [&](int a, int b)
+                     { return by_x ? pts_[a].x < pts_[b].x : pts_[a].y < pts_[b].y; });
+    build(lo, mid, depth + 1);
+    build(mid + 1, hi, depth + 1);
+}
+
+namespace
+{
+    // Обход дерева: в heap - лучшие найденные (квадрат расстояния, номер), наверху худший.
+    // limit - сколько нужно (0 - без ограничения), bound2 - квадрат наибольшего расстояния.
+    struct Search
+    {
+        const std::vector<Pt> &pts;
+        const std::vector<int> &idx;
+        Pt q;
+        size_t limit;
+        double bound2;
+        std::priority_queue<std::pair<double, int>> heap;
+
+        double worst2() const { return limit && heap.size() == limit ? heap.top().first : bound2; }
+
+        void run(int lo, int hi, int depth)
+        {
+            if (lo >= hi)
+                return;
+            int mid = (lo + hi) / 2;
+            int i = idx[mid];
+            const Pt &p = pts[i];
+            double d2 = norm2(p - q);
+            std::pair<double, int> c{d2, i};
+            if (d2 <= bound2 && (!limit || heap.size() < limit || c < heap.top()))
+            {
+                heap.push(c);
+                if (limit && heap.size() > limit)
+                    heap.pop();
+            }
+            double diff = depth % 2 == 0 ? q.x - p.x : q.y - p.y;
+            if (diff < 0)
+            {
+                run(lo, mid, depth + 1);
+                if (diff * diff <= worst2())
+                    run(mid + 1, hi, depth + 1);
+            }
+            else
+            {
+                run(mid + 1, hi, depth + 1);
+                if (diff * diff <= worst2())
+                    run(lo, mid, depth + 1);
+            }
+        }
+
+        void collect(std::vector<std::pair<double, int>> &out)
+        {
+            out.clear();
+            out.reserve(heap.size());
+            for (; !heap.empty(); heap.pop())
+                out.emplace_back(std::sqrt(heap.top().first), heap.top().second);
+            std::reverse(out.begin(), out.end());
+        }
+    };
+}
+
+void KdTree::nearest(Pt q, int k, std::vector<std::pair<double, int>> &out, double max_dist) const
+{
+    out.clear();
+    if (k <= 0)
+        return;
+    Search s{pts_, idx_, q, (size_t)k, max_dist * max_dist, {}};
+    s.run(0, (int)idx_.size(), 0);
+    s.collect(out);
+}
+
+void KdTree::within(Pt q, double r, std::vector<std::pair<double, int>> &out) const
+{
+    Search s{pts_, idx_, q, 0, r * r, {}};
+    s.run(0, (int)idx_.size(), 0);
+    s.collect(out);
+}
+
+std::vector<std::vector<Snap>> snap_points(const std::vector<Pt> &nodes, const KdTree &tree,
+                                           const std::vector<Pt> &points, const SnapParams &prm,
+                                           SnapStats *stats, int threads)
+{
+    std::vector<std::vector<Snap>> out(points.size());
+    std::vector<int> rejected(points.size(), 0);
+    std::unique_ptr<BoxGrid> grid;
+    if (prm.roads)
+    {
+        std::vector<BoxGrid::Box> boxes;
+        for (const auto &poly : prm.roads->polygons)
+            boxes.push_back(BoxGrid::box_of(poly.ring));
+        grid.reset(new BoxGrid);
+        grid->build(boxes);
+    }
+    const double max_dist = prm.radius > 0.0 ? prm.radius : INFINITY;
+
+    const int CHUNK = 256;
+    const int N = (int)points.size();
+    parallel_for((N + CHUNK - 1) / CHUNK, [&](int c)
+                 {
+        std::vector<std::pair<double, int>> cand;
+        std::vector<int> polys, home;
+        for (int i = c * CHUNK; i < std::min(N, (c + 1) * CHUNK); ++i)
+        {
+            const Pt q = points[i];
+            // дорога, в которой стоит сама точка, не мешает: из неё выходят к её же краю
+            home.clear();
+            if (grid)
+            {
+                grid->query(Seg{q, q}, polys);
+                for (int p : polys)
+                    if (polygon_contains(prm.roads->polygons[p], q))
+                        home.push_back(p);
+            }
+            auto crosses = [&](int node)
+            {
+                Seg s{q, nodes[node]};
+                grid->query(s, polys);
+                for (int p : polys)
+                    if (std::find(home.begin(), home.end(), p) == home.end() &&
+                        seg_crosses_road(s, prm.roads->polygons[p]))
+                        return true;
+                return false;
+            };
+
+            if (prm.k <= 0)
+            {
+                if (prm.radius > 0.0)
+                    tree.within(q, prm.radius, cand);
+                else
+                    cand.clear();
+                for (auto [d, node] : cand)
+                {
+                    if (grid && crosses(node))
+                        rejected[i]++;
+                    else
+                        out[i].push_back({node, d});
+                }
+                continue;
+            }
+
+            // кандидатов расширяем, если проверка дорог отбросила слишком многих, но не дальше max_candidates
+            const size_t limit = std::max((size_t)prm.k, (size_t)prm.max_candidates);
+            size_t tested = 0;
+            for (size_t want = prm.k; out[i].size() < (size_t)prm.k && tested < limit; want *= 4)
+            {
+                tree.nearest(q, (int)std::min({want, limit, tree.size()}), cand, max_dist);
+                for (size_t j = tested; j < cand.size() && out[i].size() < (size_t)prm.k; ++j)
+                {
+                    if (grid && crosses(cand[j].second))
+                        rejected[i]++;
+                    else
+                        out[i].push_back({cand[j].second, cand[j].first});
+                }
+                tested = cand.size();
+                if (cand.size() < std::min(want, limit) || !grid)
+                    break; // ближе max_dist больше узлов нет
+            }
+        } }, threads);
+
+    if (stats)
+    {
+        *stats = SnapStats{};
+        for (size_t i = 0; i < points.size(); ++i)
+        {
+            (out[i].empty() ? stats->unsnapped : stats->snapped)++;
+            stats->rejected += rejected[i];
+        }
+    }
+    return out;
+}
+
+// Значение после "key": в тексте фичи: числа массива или строка/число как текст.
+// Без регулярных выражений io::extract_*: на десятках тысяч точек они дороже самой привязки.
+static const char *value_after(const std::string &f, const char *key)
+{
+    size_t k = f.find(key);
+    if (k == std::string::npos)
+        return nullptr;
+    const char *p = f.c_str() + k + std::strlen(key);
+    while (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r' || *p == ':')
+        ++p;
+    return p;
+}
+
+// Разбор фичи по уровням вложенности: value_after находит ключ где угодно, в том числе в
+// строках и вложенных объектах, а для id важно, чей он.
+static const char *skip_ws(const char *p)
+{
+    while (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r')
+        ++p;
+    return p;
+}
+
+static void append_utf8(std::string &out, unsigned cp)
+{
+    if (cp < 0x80)
+        out += (char)cp;
+    else if (cp < 0x800)
+    {
+        out += (char)(0xC0 | (cp >> 6));
+        out += (char)(0x80 | (cp & 0x3F));
+    }
+    else if (cp < 0x10000)
+    {
+        out += (char)(0xE0 | (cp >> 12));
+        out += (char)(0x80 | ((cp >> 6) & 0x3F));
+        out += (char)(0x80 | (cp & 0x3F));
+    }
+    else
+    {
+        out += (char)(0xF0 | (cp >> 18));
+        out += (char)(0x80 | ((cp >> 12) & 0x3F));
+        out += (char)(0x80 | ((cp >> 6) & 0x3F));
+        out += (char)(0x80 | (cp & 0x3F));
+    }
+}
+
+static bool hex4(const char *p, unsigned &v)
+{
+    v = 0;
+    for (int i = 0; i < 4; ++i)
+    {
+        char c = p[i];
+        int d = c >= '0' && c <= '9' ? c - '0' : c >= 'a' && c <= 'f' ? c - 'a' + 10 : c >= 'A' && c <= 'F' ? c - 'A' + 10 : -1;
+        if (d < 0)
+            return false;
+        v = v * 16 + (unsigned)d;
+    }
+    return true;
+}
+
+// Строка JSON с p на открывающей кавычке: экранирование раскрывается (\uXXXX - в UTF-8,
+// с суррогатными парами). Возвращает позицию за закрывающей кавычкой, nullptr - строка не закрыта.
+static const char *parse_string(const char *p, std::string &out)
+{
+    out.clear();
+    for (++p; *p && *p != '"'; ++p)
+    {
+        if (*p != '\\')
+        {
+            out += *p;
+            continue;
+        }
+        ++p;
+        switch (*p)
+        {
+        case 'b':
+            out += '\b';
+            break;
+        case 'f':
+            out += '\f';
+            break;
+        case 'n':
+            out += '\n';
+            break;
+        case 'r':
+            out += '\r';
+            break;
+        case 't':
+            out += '\t';
+            break;
+        case 'u':
+        {
+            unsigned cp, lo;
+            if (!hex4(p + 1, cp))
+                return nullptr;
+            p += 4;
+            if (cp >= 0xD800 && cp < 0xDC00 && p[1] == '\\' && p[2] == 'u' && hex4(p + 3, lo) && lo >= 0xDC00 && lo < 0xE000)
+            {
+                cp = 0x10000 + ((cp - 0xD800) << 10) + (lo - 0xDC00);
+                p += 6;
+            }
+            append_utf8(out, cp);
+            break;
+        }
+        case '\0':
+            return nullptr;
+        default: // \" \\ \/
+            out += *p;
+        }
+    }
+    return *p == '"' ? p + 1 : nullptr;
+}
+
+// Позиция за значением JSON, начинающимся в p (строка, объект, массив или скаляр)
+static const char *skip_value(const char *p)
+{
+    int depth = 0;
+    std::string tmp;
+    while (*p)
+    {
+        if (*p == '"')
+        {
+            p = parse_string(p, tmp);
+            if (!p)
+                return nullptr;
+            if (depth == 0)
+                return p;
+            continue;
+        }
+        if (*p == '{' || *p == '[')
+            ++depth;
+        else if (*p == '}' || *p == ']')
+        {
+            if (depth == 0)
+                return p;
+            if (--depth == 0)
+                return p + 1;
+        }
+        else if (depth == 0 && (*p == ',' || *p == ' ' || *p == '\t' || *p == '\n' || *p == '\r'))
+            return p;
+        ++p;
+    }
+    return p;
+}
+
+// Значение ключа key самого объекта, начинающегося в obj (на "{"), без захода во вложенные;
+// nullptr - ключа нет или объект не разобрался
+static const char *member(const char *obj, const char *key)
+{
+    if (!obj || *obj != '{')
+        return nullptr;
+    std::string name;
+    const char *p = skip_ws(obj + 1);
+    while (*p == '"')
+    {
+        p = parse_string(p, name);
+        if (!p)
+            return nullptr;
+        p = skip_ws(p);
+        if (*p != ':')
+            return nullptr;
+        p = skip_ws(p + 1);
+        if (name == key)
+            return p;
+        p = skip_value(p);
+        if (!p)
+            return nullptr;
+        p = skip_ws(p);
+        if (*p != ',')
+            return nullptr;
+        p = skip_ws(p + 1);
+    }
+    return nullptr;
+}
+
+bool load_points_geojson(const std::string &path, std::vector<Pt> &points, std::vector<std::string> &ids)
+{
+    points.clear();
+    ids.clear();
+    return io::for_each_feature(path, [&](const std::string &f)
+                                {
+        if (f.find("\"Point\"") == std::string::npos)
+            return;
+        const char *p = value_after(f, "\"coordinates\"");
+        if (!p || *p != '[')
+            return;
+        char *end;
+        double x = std::strtod(p + 1, &end);
+        if (end == p + 1)
+            return;
+        p = end;
+        while (*p == ' ' || *p == ',')
+            ++p;
+        double y = std::strtod(p, &end);
+        if (end == p)
+            return;
+
+        // свой id точки - properties.id, иначе id самой фичи; "id" вложенных объектов не берётся
+        std::string id;
+        const char *obj = skip_ws(f.c_str());
+        const char *v = nullptr;
+        if (const char *props = member(obj, "properties"))
+            v = member(props, "id");
+        if (!v)
+            v = member(obj, "id");
+        if (v && *v == '"')
+            parse_string(v, id);
+        else if (v && std::strncmp(v, "null", 4) != 0)
+            id.assign(v, skip_value(v));
+        points.push_back({x, y});
+        ids.push_back(id); });
+}
+
+void write_snaps(const std::string &base, const std::vector<Pt> &points, const std::vector<std::string> &ids,
+                 const std::vector<Pt> &nodes, const std::vector<std::vector<Snap>> &snaps)
+{
+    gj::StreamWriter w(base + "_snaps.geojson", "snaps");
+    for (size_t i = 0; i < points.size(); ++i)
+        for (size_t r = 0; r < snaps[i].size(); ++r)
+        {
+            const Snap &s = snaps[i][r];
+            w.add_line({points[i], nodes[s.node]}, {{"point", std::to_string(i)},
+                                                    {"id", ids[i]},
+                                                    {"node", std::to_string(s.node)},
+                                                    {"rank", std::to_string(r)},
+                                                    {"distance", std::to_string(s.dist)}});
+        }
+    w.finish();
+}
@@ -0,0 +1,306 @@
+#include "stage_cache.h"
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define STAGE_CACHE_MMAP 1
+#endif
+
+static const uint32_t CACHE_MAGIC = 0x43524743; // "CGRC"
+// увеличивать при изменении алгоритмов этапов или формата, чтобы не читать устаревшие записи
+static const uint32_t CACHE_VERSION = 4;
+
+enum : uint32_t
+{
+    STAGE_ROADS = 1,
+    STAGE_TRENCH = 2,
+    STAGE_HDD = 3
+};
+
+// Отображённый в память файл кэша (или прочитанный целиком, если mmap недоступен).
+struct MappedFile
+{
+    const char *data = nullptr;
+    size_t size = 0;
+
+    explicit MappedFile(const std::string &path)
+    {
+#ifdef STAGE_CACHE_MMAP
+        int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+            return;
+        struct stat st;
+        if (fstat(fd, &st) == 0 && st.st_size > 0)
+        {
+            void *p = mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (p != MAP_FAILED)
+            {
+                data = (const char *)p;
+                size = (size_t)st.st_size;
+            }
+        }
+        close(fd);
+#else
+        std::ifstream f(path, std::ios::binary);
+        if (!f)
+            return;
+        buf.assign(std::istreambuf_iterator<char>(f), {});
+        data = buf.data();
+        size = buf.size();
+#endif
+    }
+
+    ~MappedFile()
+    {
+#ifdef STAGE_CACHE_MMAP
+        if (data)
+            munmap((void *)data, size);
+#endif
+    }
+
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+
+#ifndef STAGE_CACHE_MMAP
+    std::vector<char> buf;
+#endif
+};
+
+struct BinReader
+{
+    const char *p, *end;
+    bool ok = true;
+
+    template <class T>
+    T get()
+    {
+        T v{};
+        if (end - p < (ptrdiff_t)sizeof(T))
+        {
+            ok = false;
+            return v;
+        }
+        std::memcpy(&v, p, sizeof(T));
+        p += sizeof(T);
+        return v;
+    }
+
+    template <class T>
+    void array(std::vector<T> &out)
+    {
+        uint64_t n = get<uint64_t>();
+        if (!ok || (uint64_t)(end - p) / sizeof(T) < n)
+        {
+            ok = false;
+            return;
+        }
+        out.resize(n);
+        if (n)
+            std::memcpy((void *)out.data(), p, n * sizeof(T));
+        p += n * sizeof(T);
+    }
+};
+
+struct BinWriter
+{
+    std::string buf;
+
+    template <class T>
+    void put(const T &v) { buf.append((const char *)&v, sizeof(T)); }
+
+    template <class T>
+    void array(const std::vector<T> &v)
+    {
+        put<uint64_t>(v.size());
+        buf.append((const char *)v.data(), v.size() * sizeof(T));
+    }
+};
+
+StageCache::StageCache(std::string dir) : dir_(std::move(dir))
+{
+#ifdef STAGE_CACHE_MMAP
+    if (!dir_.empty())
+        mkdir(dir_.c_str(), 0755);
+#endif
+}
+
+uint64_t StageCache::hash(const void *data, size_t n, uint64_t seed)
+{
+    const unsigned char *p = (const unsigned char *)data;
+    uint64_t h = seed;
+    for (size_t i = 0; i < n; ++i)
+    {
+        h ^= p[i];
+        h *= 1099511628211ull;
+    }
+    return h;
+}
+
+std::string StageCache::path(const char *stage, uint64_t key) const
+{
+    char name[64];
+    std::snprintf(name, sizeof(name), "%s-%016llx.bin", stage, (unsigned long long)key);
+    return dir_ + "/" + name;
+}
+
+static bool open_stage(const MappedFile &f, BinReader &r, uint32_t stage, uint64_t key)
+{
+    if (!f.data)
+        return false;
+    r = {f.data, f.data + f.size};
+    return r.get<uint32_t>() == CACHE_MAGIC && r.get<uint32_t>() == CACHE_VERSION &&
+           r.get<uint32_t>() == stage && r.get<uint64_t>() == key && r.ok;
+}
+
+static void write_stage(const std::string &path, uint32_t stage, uint64_t key, const BinWriter &body)
+{
+    BinWriter head;
+    head.put(CACHE_MAGIC);
+    head.put(CACHE_VERSION);
+    head.put(stage);
+    head.put(key);
+
+    // через временный файл, чтобы параллельный читатель не увидел недописанную запись
+    std::string tmp = path + ".tmp";
+    {
+        std::ofstream f(tmp, std::ios::binary);
+        if (!f)
+            return;
+        f.write(head.buf.data(), head.buf.size());
+        f.write(body.buf.data(), body.buf.size());
+        if (!f)
+            return;
+    }
+    std::rename(tmp.c_str(), path.c_str());
+}
+
+bool StageCache::load(uint64_t key, Roads &roads) const
+{
+    if (!enabled())
+        return false;
+    MappedFile f(path("roads", key));
+    BinReader r{nullptr, nullptr};
+    if (!open_stage(f, r, STAGE_ROADS, key))
+        return false;
+
+    std::vector<uint64_t> poly_sizes, line_sizes;
+    std::vector<Pt> pts;
+    r.array(poly_sizes);
+    r.array(line_sizes);
+    r.array(pts);
+    if (!r.ok)
+        return false;
+
+    Roads out;
+    size_t off = 0;
+    for (uint64_t n : poly_sizes)
+    {
+        if (off + n > pts.size())
+            return false;
+        out.polygons.push_back({std::vector<Pt>(pts.begin() + off, pts.begin() + off + n), {}, {}});
+        off += n;
+    }
+    for (uint64_t n : line_sizes)
+    {
+        if (off + n > pts.size())
+            return false;
+        out.lines.emplace_back(pts.begin() + off, pts.begin() + off + n);
+        off += n;
+    }
+    roads = std::move(out);
+    return true;
+}
+
+void StageCache::store(uint64_t key, const Roads &roads) const
+{
+    if (!enabled())
+        return;
+    std::vector<uint64_t> poly_sizes, line_sizes;
+    std::vector<Pt> pts;
+    for (const auto &p : roads.polygons)
+    {
+        poly_sizes.push_back(p.ring.size());
+        pts.insert(pts.end(), p.ring.begin(), p.ring.end());
+    }
+    for (const auto &l : roads.lines)
+    {
+        line_sizes.push_back(l.size());
+        pts.insert(pts.end(), l.begin(), l.end());
+    }
+    BinWriter w;
+    w.array(poly_sizes);
+    w.array(line_sizes);
+    w.array(pts);
+    write_stage(path("roads", key), STAGE_ROADS, key, w);
+}
+
+bool StageCache::load(uint64_t key, TrenchGraph &g) const
+{
+    if (!enabled())
+        return false;
+    MappedFile f(path("trench", key));
+    BinReader r{nullptr, nullptr};
+    if (!open_stage(f, r, STAGE_TRENCH, key))
+        return false;
+    TrenchGraph out;
+    r.array(out.nodes);
+    r.array(out.edges);
+    out.removed_edges = r.get<int>();
+    out.open_outline_rings = r.get<int>();
+    if (!r.ok)
+        return false;
+    g = std::move(out);
+    return true;
+}
+
+void StageCache::store(uint64_t key, const TrenchGraph &g) const
+{
+    if (!enabled())
+        return;
+    BinWriter w;
+    w.array(g.nodes);
+    w.array(g.edges);
+    w.put(g.removed_edges);
+    w.put(g.open_outline_rings);
+    write_stage(path("trench", key), STAGE_TRENCH, key, w);
+}
+
+bool StageCache::load(uint64_t key, HDDGraph &g) const
+{
+    if (!enabled())
+        return false;
+    MappedFile f(path("hdd", key));
+    BinReader r{nullptr, nullptr};
+    if (!open_stage(f, r, STAGE_HDD, key))
+        return false;
+    HDDGraph out;
+    r.array(out.nodes);
+    r.array(out.edges);
+    r.array(out.trench_to_hdd);
+    out.trench_edge_count = r.get<int>();
+    r.array(out.edge_alpha);
+    if (!r.ok)
+        return false;
+    g = std::move(out);
+    return true;
+}
+
+void StageCache::store(uint64_t key, const HDDGraph &g) const
+{
+    if (!enabled())
+        return;
+    BinWriter w;
+    w.array(g.nodes);
+    w.array(g.edges);
+    w.array(g.trench_to_hdd);
+    w.put(g.trench_edge_count);
+    w.array(g.edge_alpha);
+    write_stage(path("hdd", key), STAGE_HDD, key, w);
+}
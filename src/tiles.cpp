@@ -0,0 +1,395 @@
+#include "tiles.h"
+#include "mvt_writer.h"
+#include "parallel.h"
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdio>
+#include <filesystem>
+#include <map>
+
+static const double WORLD = 20037508.342789244; // половина ширины мира в EPSG:3857, м
+static const int EXTENT = 4096;
+static const int BUFFER = 64; // запас вокруг тайла, единиц тайла
+static const int HDD_CELL_PX = 64; // ячейка слияния рёбер ГНБ на низких зумах, единиц тайла (~8 px экрана)
+
+struct LineFeature
+{
+    std::vector<Pt> pts;
+    mvt::Props props;
+};
+
+struct PointFeature
+{
+    Pt p;
+    mvt::Props props;
+};
+
+struct TileLayer
+{
+    const char *name;
+    std::vector<LineFeature> lines;
+    std::vector<PointFeature> points;
+};
+
+// объекты одного зума, общие для всех его тайлов
+struct ZoomData
+{
+    int z;
+    double tile_size; // м
+    std::vector<TileLayer> layers;
+};
+
+// цепочки рёбер траншей между узлами степени != 2 (и замкнутые кольца из узлов степени 2)
+static std::vector<std::vector<int>> degree2_chains(const TrenchGraph &g, const std::vector<int> &deg)
+{
+    int N = (int)g.nodes.size(), E = (int)g.edges.size();
+    std::vector<int> offset(N + 1, 0), inc(2 * E);
+    for (auto [u, v] : g.edges)
+    {
+        offset[u + 1]++;
+        offset[v + 1]++;
+    }
+    for (int i = 0; i < N; ++i)
+        offset[i + 1] += offset[i];
+    std::vector<int> pos(offset.begin(), offset.end() - 1);
+    for (int e = 0; e < E; ++e)
+    {
+        inc[pos[g.edges[e].first]++] = e;
+        inc[pos[g.edges[e].second]++] = e;
+    }
+
+    std::vector<char> used(E, 0);
+    std::vector<std::vector<int>> chains;
+    auto walk = [&](int start, int e)
+    {
+        std::vector<int> chain{start};
+        int cur = start;
+        while (e >= 0)
+        {
+            used[e] = 1;
+            cur = g.edges[e].first == cur ? g.edges[e].second : g.edges[e].first;
+            chain.push_back(cur);
+            if (deg[cur] != 2 || cur == start)
+                break;
+            int next = -1;
+            for (int k = offset[cur]; k < offset[cur + 1]; ++k)
+                if (!used[inc[k]])
+                    next = inc[k];
+            e = next;
+        }
+        chains.push_back(std::move(chain));
+    };
+
+    for (int u = 0; u < N; ++u)
+        if (deg[u] != 2)
+            for (int k = offset[u]; k < offset[u + 1]; ++k)
+                if (!used[inc[k]])
+                    walk(u, inc[k]);
+    for (int e = 0; e < E; ++e)
+        if (!used[e])
+            walk(g.edges[e].first, e);
+    return chains;
+}
+
+// выбрасывает вершины ближе tol к последней оставленной (концы сохраняются)
+static std::vector<Pt> thin(const std::vector<Pt> &pts, double tol)
+{
+    std::vector<Pt> out{pts.front()};
+    for (size_t i = 1; i + 1 < pts.size(); ++i)
+        if (norm(pts[i] - out.back()) >= tol)
+            out.push_back(pts[i]);
+    out.push_back(pts.back());
+    return out;
+}
+
+static ZoomData build_zoom(int z, bool max_zoom, const Config &cfg, const TrenchGraph &trench,
+                           const HDDGraph &hdd, const std::vector<int> &deg,
+                           const std::vector<std::vector<int>> &chains, const Region *region)
+{
+    ZoomData zd;
+    zd.z = z;
+    zd.tile_size = 2 * WORLD / std::ldexp(1.0, z);
+    double px = zd.tile_size / EXTENT;
+    auto keep = [&](const Pt &p)
+    { return !region || region->contains(p); };
+
+    TileLayer lines{"trench", {}, {}}, nodes{"trench_nodes", {}, {}}, cross{"hdd", {}, {}}, trans{"transitions", {}, {}};
+
+    if (max_zoom)
+    {
+        for (auto [u, v] : trench.edges)
+        {
+            const Pt &a = trench.nodes[u], &b = trench.nodes[v];
+            if (!keep(a) && !keep(b))
+                continue;
+            double L = norm(b - a);
+            lines.lines.push_back({{a, b}, {{"length", L}, {"cost", L * cfg.trench_per_m}}});
+        }
+    }
+    else
+    {
+        for (const auto &c : chains)
+        {
+            std::vector<Pt> pts;
+            double L = 0.0;
+            bool any = false;
+            for (size_t k = 0; k < c.size(); ++k)
+            {
+                pts.push_back(trench.nodes[c[k]]);
+                any = any || keep(pts.back());
+                if (k)
+                    L += norm(pts[k] - pts[k - 1]);
+            }
+            if (any)
+                lines.lines.push_back({thin(pts, px), {{"length", L}, {"cost", L * cfg.trench_per_m}}});
+        }
+    }
+
+    for (size_t i = 0; i < trench.nodes.size(); ++i)
+    {
+        if (!keep(trench.nodes[i]) || (!max_zoom && deg[i] == 2))
+            continue;
+        nodes.points.push_back({trench.nodes[i], {{"id", (double)i}, {"degree", (double)deg[i]}}});
+        if (max_zoom)
+            trans.points.push_back({trench.nodes[i], {{"cost", cfg.transition_per_edge}}});
+    }
+
+    // поперечные рёбра ГНБ (рёбра траншей в графе ГНБ уже есть в слое trench)
+    struct Agg
+    {
+        Pt a{0, 0}, b{0, 0};
+        double length = 0.0;
+        int count = 0;
+    };
+    std::map<std::pair<long long, long long>, Agg> groups;
+    double cell = HDD_CELL_PX * px;
+    auto cell_of = [&](const Pt &p)
+    { return ((long long)std::floor(p.x / cell) << 32) ^ ((long long)std::floor(p.y / cell) & 0xffffffff); };
+
+    for (size_t e = hdd.trench_edge_count; e < hdd.edges.size(); ++e)
+    {
+        Pt a = hdd.nodes[hdd.edges[e].first], b = hdd.nodes[hdd.edges[e].second];
+        if (!keep(a) && !keep(b))
+            continue;
+        double L = norm(b - a);
+        if (max_zoom)
+        {
+            cross.lines.push_back({{a, b}, {{"length", L}, {"cost", L * cfg.hdd_per_m}, {"alpha", hdd.edge_alpha[e]}}});
+            continue;
+        }
+        long long ka = cell_of(a), kb = cell_of(b);
+        if (kb < ka)
+        {
+            std::swap(ka, kb);
+            std::swap(a, b);
+        }
+        Agg &g = groups[{ka, kb}];
+        g.a = g.a + a;
+        g.b = g.b + b;
+        g.length += L;
+        g.count++;
+    }
+    for (const auto &[key, g] : groups)
+    {
+        double L = g.length / g.count;
+        cross.lines.push_back({{g.a * (1.0 / g.count), g.b * (1.0 / g.count)},
+                               {{"length", L}, {"cost", L * cfg.hdd_per_m}, {"count", (double)g.count}}});
+    }
+
+    zd.layers = {std::move(lines), std::move(nodes), std::move(cross), std::move(trans)};
+    return zd;
+}
+
+// отрезки ломаной внутри квадрата [lo, hi]^2 (Лианг-Барски), подряд идущие - одной частью
+static void clip_polyline(const std::vector<std::pair<double, double>> &p, double lo, double hi,
+                          std::vector<std::vector<mvt::TilePt>> &out)
+{
+    auto rnd = [](double x, double y)
+    { return mvt::TilePt{(int)std::lround(x), (int)std::lround(y)}; };
+    int cur = -1;
+    for (size_t i = 1; i < p.size(); ++i)
+    {
+        double x0 = p[i - 1].first, y0 = p[i - 1].second;
+        double dx = p[i].first - x0, dy = p[i].second - y0;
+        double t0 = 0.0, t1 = 1.0;
+        bool visible = true;
+        for (auto [q, r] : {std::pair{-dx, x0 - lo}, {dx, hi - x0}, {-dy, y0 - lo}, {dy, hi - y0}})
+        {
+            if (q == 0.0)
+            {
+                if (r < 0.0)
+                    visible = false;
+                continue;
+            }
+            double t = r / q;
+            if (q < 0.0)
+                t0 = std::max(t0, t);
+            else
+                t1 = std::min(t1, t);
+        }
+        if (!visible || t0 > t1)
+        {
+            cur = -1;
+            continue;
+        }
+        if (cur < 0 || t0 > 0.0)
+        {
+            out.emplace_back();
+            cur = (int)out.size() - 1;
+            out[cur].push_back(rnd(x0 + dx * t0, y0 + dy * t0));
+        }
+        out[cur].push_back(rnd(x0 + dx * t1, y0 + dy * t1));
+        if (t1 < 1.0)
+            cur = -1;
+    }
+}
+
+struct TileJob
+{
+    int zoom; // индекс в zooms
+    int x, y;
+    std::vector<std::pair<int, int>> refs; // (слой, номер объекта; у слоя сначала линии, потом точки)
+};
+
+int write_tiles(const std::string &base, const Config &cfg, const TrenchGraph &trench, const HDDGraph &hdd,
+                const Region *region, int threads)
+{
+    int zmin = std::max(0, cfg.tile_min_zoom), zmax = std::min(24, cfg.tile_max_zoom);
+    if (zmin > zmax)
+        return 0;
+
+    std::vector<int> deg(trench.nodes.size(), 0);
+    for (auto [u, v] : trench.edges)
+    {
+        deg[u]++;
+        deg[v]++;
+    }
+    auto chains = degree2_chains(trench, deg);
+
+    int nz = zmax - zmin + 1;
+    std::vector<ZoomData> zooms(nz);
+    parallel_for(nz, [&](int k)
+                 { zooms[k] = build_zoom(zmin + k, zmin + k == zmax, cfg, trench, hdd, deg, chains, region); }, threads);
+
+    // раскладка объектов по тайлам (по рамке с запасом)
+    std::vector<TileJob> jobs;
+    for (int k = 0; k < nz; ++k)
+    {
+        const ZoomData &zd = zooms[k];
+        int n = 1 << zd.z;
+        double pad = zd.tile_size * BUFFER / EXTENT;
+        std::map<std::pair<int, int>, std::vector<std::pair<int, int>>> buckets;
+        auto add = [&](double x0, double y0, double x1, double y1, int layer, int idx)
+        {
+            int tx0 = std::max(0, (int)std::floor((x0 - pad + WORLD) / zd.tile_size));
+            int tx1 = std::min(n - 1, (int)std::floor((x1 + pad + WORLD) / zd.tile_size));
+            int ty0 = std::max(0, (int)std::floor((WORLD - y1 - pad) / zd.tile_size));
+            int ty1 = std::min(n - 1, (int)std::floor((WORLD - y0 + pad) / zd.tile_size));
+            for (int tx = tx0; tx <= tx1; ++tx)
+                for (int ty = ty0; ty <= ty1; ++ty)
+                    buckets[{tx, ty}].emplace_back(layer, idx);
+        };
+        for (int l = 0; l < (int)zd.layers.size(); ++l)
+        {
+            const TileLayer &tl = zd.layers[l];
+            for (int i = 0; i < (int)tl.lines.size(); ++i)
+            {
+                double x0 = 1e300, y0 = 1e300, x1 = -1e300, y1 = -1e300;
+                for (const Pt &p : tl.lines[i].pts)
+                {
+                    x0 = std::min(x0, p.x);
+                    y0 = std::min(y0, p.y);
+                    x1 = std::max(x1, p.x);
+                    y1 = std::max(y1, p.y);
+                }
+                add(x0, y0, x1, y1, l, i);
+            }
+            for (int i = 0; i < (int)tl.points.size(); ++i)
+            {
+                const Pt &p = tl.points[i].p;
+                add(p.x, p.y, p.x, p.y, l, (int)tl.lines.size() + i);
+            }
+        }
+        for (auto &[xy, refs] : buckets)
+            jobs.push_back({k, xy.first, xy.second, std::move(refs)});
+    }
+
+    std::string dir = base + "_tiles";
+    std::atomic<int> written{0};
+    parallel_for((int)jobs.size(), [&](int t)
+                 {
+        const TileJob &j = jobs[t];
+        const ZoomData &zd = zooms[j.zoom];
+        double ox = -WORLD + j.x * zd.tile_size, oy = WORLD - j.y * zd.tile_size;
+        double scale = EXTENT / zd.tile_size;
+
+        std::vector<mvt::Layer> layers;
+        for (const auto &tl : zd.layers)
+            layers.emplace_back(tl.name, EXTENT);
+
+        std::vector<std::pair<double, double>> px;
+        std::vector<std::vector<mvt::TilePt>> parts;
+        for (auto [l, idx] : j.refs)
+        {
+            const TileLayer &tl = zd.layers[l];
+            if (idx < (int)tl.lines.size())
+            {
+                const LineFeature &f = tl.lines[idx];
+                px.clear();
+                for (const Pt &p : f.pts)
+                    px.emplace_back((p.x - ox) * scale, (oy - p.y) * scale);
+                parts.clear();
+                clip_polyline(px, -BUFFER, EXTENT + BUFFER, parts);
+                if (!parts.empty())
+                    layers[l].add_lines(parts, f.props);
+            }
+            else
+            {
+                const PointFeature &f = tl.points[idx - tl.lines.size()];
+                double x = (f.p.x - ox) * scale, y = (oy - f.p.y) * scale;
+                if (x >= -BUFFER && x <= EXTENT + BUFFER && y >= -BUFFER && y <= EXTENT + BUFFER)
+                    layers[l].add_point({(int)std::lround(x), (int)std::lround(y)}, f.props);
+            }
+        }
+        // объекты тайла могли целиком отсечься по его границе - пустые тайлы не пишем
+        std::string tile = mvt::encode_tile(layers);
+        if (tile.empty())
+            return;
+        std::string col = dir + "/" + std::to_string(zd.z) + "/" + std::to_string(j.x);
+        std::error_code ec; // каталог мог создать соседний поток
+        std::filesystem::create_directories(col, ec);
+        save_text(col + "/" + std::to_string(j.y) + ".pbf", tile);
+        written++; }, threads);
+
+    // метаданные в духе TileJSON: границы в градусах, зумы, слои
+    double x0 = 1e300, y0 = 1e300, x1 = -1e300, y1 = -1e300;
+    for (const Pt &p : trench.nodes)
+    {
+        if (region && !region->contains(p))
+            continue;
+        x0 = std::min(x0, p.x);
+        y0 = std::min(y0, p.y);
+        x1 = std::max(x1, p.x);
+        y1 = std::max(y1, p.y);
+    }
+    auto lon = [](double x)
+    { return x / WORLD * 180.0; };
+    auto lat = [](double y)
+    { return (2.0 * std::atan(std::exp(y / 6378137.0)) - M_PI / 2) * 180.0 / M_PI; };
+    char meta[1024];
+    if (x0 > x1)
+        x0 = y0 = x1 = y1 = 0.0;
+    snprintf(meta, sizeof(meta),
+             "{\"tilejson\":\"3.0.0\",\"tiles\":[\"{z}/{x}/{y}.pbf\"],\"format\":\"pbf\","
+             "\"minzoom\":%d,\"maxzoom\":%d,\"bounds\":[%.6f,%.6f,%.6f,%.6f],"
+             "\"vector_layers\":["
+             "{\"id\":\"trench\",\"fields\":{\"length\":\"Number\",\"cost\":\"Number\"}},"
+             "{\"id\":\"trench_nodes\",\"fields\":{\"id\":\"Number\",\"degree\":\"Number\"}},"
+             "{\"id\":\"hdd\",\"fields\":{\"length\":\"Number\",\"cost\":\"Number\",\"alpha\":\"Number\",\"count\":\"Number\"}},"
+             "{\"id\":\"transitions\",\"fields\":{\"cost\":\"Number\"}}]}",
+             zmin, zmax, lon(x0), lat(y0), lon(x1), lat(y1));
+    std::filesystem::create_directories(dir);
+    save_text(dir + "/metadata.json", meta);
+    return written;
+}